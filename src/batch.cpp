@@ -0,0 +1,337 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+// Batch driver: runs dynamic_mm_optimize for every job of a job list, as separate processes within a core budget.
+//
+// usage: dynamic_mm_batch <jobs> [options]
+//   --out <dir>             output directory (default batch_out), gets <job>.txt, <job>_paths.txt, <job>.log and summary.tsv
+//   --cores <n>             core budget shared by all running jobs (default: all cores)
+//   --optimizer <path>      dynamic_mm_optimize executable (default: next to this one)
+//   --cache-file <file>     evaluation cache shared by all jobs
+//
+// Job list, one job per line ('#' starts a comment):
+//   <name> <config> [dynamic_mm_optimize options...]
+// e.g. "heart ../configs/heart.txt --iterations 200 --dof-weight 3". A config holding several models separated by
+// "## <model> ##" lines (like configs/all.txt) becomes one job per model, named <name>_<model>.
+// A job occupies as many cores as the optimizer will run threads: replicas (--replicas 0 is one per core), designs
+// evaluated at once (--exhaustive: --threads, default all cores) or path sets simulated at once (--threads, default
+// one per path set and candidate), each times --step-threads. It never gets more than half the budget, so big jobs
+// cannot starve small ones; a job capped by that gets --threads lowered to fit. Jobs start in list order and smaller
+// jobs further down fill cores that are left over.
+
+struct Job {
+	std::string name;
+	std::string config;
+	std::vector<std::string> args;
+	// --threads passed on to the optimizer, -1 to leave the optimizer's default
+	int threads = -1;
+	int cores = 1;
+	int pid = -1;
+	std::chrono::steady_clock::time_point start;
+	double seconds = 0;
+	int status = -1;
+	bool done = false;
+};
+
+void print_usage()
+{
+	std::cout << "usage: dynamic_mm_batch <jobs> [--out <dir>] [--cores <n>] [--optimizer <path>] [--cache-file <file>]" << std::endl;
+}
+
+std::string trim(std::string s)
+{
+	size_t b = s.find_first_not_of(" \t\r\n");
+	size_t e = s.find_last_not_of(" \t\r\n");
+	return b == std::string::npos ? "" : s.substr(b, e - b + 1);
+}
+
+// splits a concatenated config into (model name, text) pairs; a plain config yields a single unnamed model
+std::vector<std::pair<std::string, std::string>> split_models(std::string filePath)
+{
+	std::vector<std::pair<std::string, std::string>> models;
+	std::ifstream file(filePath);
+	if (!file.good())
+	{
+		std::cout << "file " << filePath << " not found!" << std::endl;
+		return models;
+	}
+	std::string line;
+	while (std::getline(file, line))
+	{
+		size_t open = line.find("## ");
+		size_t close = open == std::string::npos ? std::string::npos : line.find(" ##", open + 3);
+		if (close != std::string::npos)
+		{
+			// the header is the first line loadFromFile skips, drop anything before the marker (e.g. "graph.js:346")
+			models.push_back(std::make_pair(trim(line.substr(open + 3, close - open - 3)), line.substr(open) + "\n"));
+			continue;
+		}
+		if (models.empty())
+			models.push_back(std::make_pair("", ""));
+		models.back().second += line + "\n";
+	}
+	return models;
+}
+
+std::vector<Job> read_jobs(std::string filePath, std::string outDir, int coreCap)
+{
+	std::vector<Job> jobs;
+	std::ifstream file(filePath);
+	if (!file.good())
+	{
+		std::cout << "file " << filePath << " not found!" << std::endl;
+		return jobs;
+	}
+	std::string line;
+	while (std::getline(file, line))
+	{
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty())
+			continue;
+		std::istringstream in(line);
+		Job job;
+		in >> job.name >> job.config;
+		std::string arg;
+		while (in >> arg)
+			job.args.push_back(arg);
+		int replicas = -1, stepThreads = 1, pathSets = 1, candidates = 1;
+		bool exhaustive = false;
+		for (int i = 0; i < job.args.size(); i++)
+		{
+			bool hasValue = i + 1 < job.args.size();
+			if (job.args[i] == "--threads" && hasValue)
+			{
+				// passed on again by launch, after capping
+				job.threads = std::atoi(job.args[i + 1].c_str());
+				job.args.erase(job.args.begin() + i, job.args.begin() + i + 2);
+				i--;
+			}
+			else if (job.args[i] == "--replicas" && hasValue)
+				replicas = std::atoi(job.args[i + 1].c_str());
+			else if (job.args[i] == "--candidates" && hasValue)
+				candidates = std::max(1, std::atoi(job.args[i + 1].c_str()));
+			else if (job.args[i] == "--step-threads" && hasValue)
+				stepThreads = std::max(1, std::atoi(job.args[i + 1].c_str()));
+			else if (job.args[i] == "--set" && hasValue)
+				pathSets++;
+			else if (job.args[i] == "--exhaustive")
+				exhaustive = true;
+		}
+		// the optimizer's own defaults for each mode
+		int allCores = std::max(1u, std::thread::hardware_concurrency());
+		int jobThreads;
+		if (exhaustive)
+			jobThreads = job.threads > 0 ? job.threads : allCores;
+		else if (replicas >= 0)
+			jobThreads = replicas > 0 ? replicas : std::max(2, allCores);
+		else
+			jobThreads = job.threads > 0 ? job.threads : std::min(pathSets * candidates, allCores);
+		job.cores = std::min(jobThreads * stepThreads, coreCap);
+		// replicas are part of the search itself and are left alone
+		if ((exhaustive || replicas < 0) && jobThreads * stepThreads > coreCap)
+			job.threads = std::max(1, coreCap / stepThreads);
+
+		auto models = split_models(job.config);
+		if (models.size() <= 1)
+		{
+			jobs.push_back(job);
+			continue;
+		}
+		for (auto& model : models)
+		{
+			Job modelJob = job;
+			modelJob.name = job.name + "_" + (model.first.empty() ? std::to_string(jobs.size()) : model.first);
+			modelJob.config = outDir + "/" + modelJob.name + "_config.txt";
+			std::ofstream out(modelJob.config);
+			out << model.second;
+			jobs.push_back(modelJob);
+		}
+	}
+	return jobs;
+}
+
+#ifndef _WIN32
+
+int launch(Job& job, std::string optimizer, std::string outDir, std::string cacheFile)
+{
+	std::vector<std::string> args = { optimizer, job.config };
+	args.insert(args.end(), job.args.begin(), job.args.end());
+	if (job.threads >= 0)
+	{
+		args.push_back("--threads");
+		args.push_back(std::to_string(job.threads));
+	}
+	if (!cacheFile.empty())
+	{
+		args.push_back("--cache-file");
+		args.push_back(cacheFile);
+	}
+	args.push_back("--out");
+	args.push_back(outDir + "/" + job.name);
+	std::vector<char*> argv;
+	for (std::string& arg : args)
+		argv.push_back(&arg[0]);
+	argv.push_back(nullptr);
+
+	std::string logPath = outDir + "/" + job.name + ".log";
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+	pid_t pid;
+	int err = posix_spawn(&pid, optimizer.c_str(), &actions, nullptr, argv.data(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+	if (err != 0)
+	{
+		std::cout << "could not start " << optimizer << " for job " << job.name << std::endl;
+		return -1;
+	}
+	return pid;
+}
+
+#endif
+
+// last "Best weighted error: <e>" line the optimizer printed
+std::string best_error(std::string logPath)
+{
+	std::ifstream log(logPath);
+	std::string line, error = "-";
+	const std::string prefix = "Best weighted error: ";
+	while (std::getline(log, line))
+	{
+		if (line.compare(0, prefix.size(), prefix) == 0)
+			error = trim(line.substr(prefix.size()));
+	}
+	return error;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::string jobFile = argv[1];
+	std::string outDir = "batch_out";
+	int cores = std::max(1u, std::thread::hardware_concurrency());
+	std::string optimizer;
+	std::string cacheFile;
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--out" && hasValue) {
+			outDir = argv[++i];
+		}
+		else if (arg == "--cores" && hasValue) {
+			cores = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--optimizer" && hasValue) {
+			optimizer = argv[++i];
+		}
+		else if (arg == "--cache-file" && hasValue) {
+			cacheFile = argv[++i];
+		}
+		else {
+			std::cout << "unknown or incomplete option " << arg << std::endl;
+			print_usage();
+			return 1;
+		}
+	}
+	if (optimizer.empty())
+	{
+		std::string self = argv[0];
+		size_t slash = self.find_last_of("/\\");
+		optimizer = (slash == std::string::npos ? std::string(".") : self.substr(0, slash)) + "/dynamic_mm_optimize";
+	}
+
+#ifdef _WIN32
+	std::cout << "dynamic_mm_batch needs posix_spawn and is not supported on this platform" << std::endl;
+	return 1;
+#else
+	mkdir(outDir.c_str(), 0755);
+	std::vector<Job> jobs = read_jobs(jobFile, outDir, std::max(1, cores / 2));
+	if (jobs.empty())
+	{
+		std::cout << "no jobs in " << jobFile << std::endl;
+		return 1;
+	}
+	std::cout << "Running " << jobs.size() << " jobs on " << cores << " cores" << std::endl;
+
+	auto batchStart = std::chrono::steady_clock::now();
+	int freeCores = cores;
+	int running = 0;
+	size_t next = 0;
+	while (next < jobs.size() || running > 0)
+	{
+		// first come first served, later jobs that fit fill cores a waiting bigger job can't use yet
+		for (size_t j = next; j < jobs.size(); j++)
+		{
+			Job& job = jobs[j];
+			if (job.pid >= 0 || job.done || job.cores > freeCores)
+				continue;
+			job.start = std::chrono::steady_clock::now();
+			job.pid = launch(job, optimizer, outDir, cacheFile);
+			if (job.pid < 0)
+			{
+				job.done = true;
+				continue;
+			}
+			std::cout << "Started " << job.name << " (" << job.cores << " cores)" << std::endl;
+			freeCores -= job.cores;
+			running++;
+		}
+		while (next < jobs.size() && (jobs[next].pid >= 0 || jobs[next].done))
+			next++;
+		if (running == 0)
+			break;
+
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0)
+			break;
+		for (Job& job : jobs)
+		{
+			if (job.pid != pid || job.done)
+				continue;
+			job.done = true;
+			job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job.start).count();
+			job.status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+			freeCores += job.cores;
+			running--;
+			std::cout << "Finished " << job.name << " in " << job.seconds << " s" << (job.status == 0 ? "" : " (failed)") << std::endl;
+		}
+	}
+
+	std::ofstream summary(outDir + "/summary.tsv");
+	summary << "job\tconfig\tstatus\tseconds\tbest_error" << std::endl;
+	int failed = 0;
+	for (Job& job : jobs)
+	{
+		summary << job.name << "\t" << job.config << "\t" << job.status << "\t" << job.seconds << "\t" << best_error(outDir + "/" + job.name + ".log") << std::endl;
+		if (job.status != 0)
+			failed++;
+	}
+	double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+	std::cout << "Ran " << jobs.size() << " jobs (" << failed << " failed) in " << total << " s, see " << outDir << "/summary.tsv" << std::endl;
+	return failed == 0 ? 0 : 1;
+#endif
+}
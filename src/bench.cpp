@@ -0,0 +1,217 @@
+#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/MMGrid.hpp"
+
+// Step time benchmark: simulates square grids of growing size with and without link collision shapes and
+// reports the time per simulation step. The bottom row is anchored and the top right joint follows a circle,
+// so the grid keeps deforming the way it does while following a path.
+// Every config given is also evaluated (getPathError) with each SimulationProfile preset, reporting the time per
+// step, the steps taken and how far the path error and calculated paths end up from the accurate preset's.
+// The scaling table steps the same grids (without collisions) with each thread count given: steps per second, the
+// speedup over one thread and how far the joints end up from the first multithreaded run's, which should be 0.
+// The solver table validates the GridSolver against Chipmunk: its time per step next to cpSpaceStep's and how far its
+// joints end up from cpSpaceStep's trajectory and from a two-thread ParallelStepper's (the same solve order, so only
+// rounding). Configs are also evaluated with two step threads, compared to Chipmunk's default profile, and with the
+// grid solver, compared to the two-thread run: getPathError removes free joints from the space but keeps their
+// pivots, which the joint trajectories above don't exercise.
+//
+// usage: dynamic_mm_bench [--max-size <n>] [--steps <n>] [--threads <n>,...] [<config>...]
+//   --max-size <n>          largest grid size, sizes double from 2 (default 32)
+//   --steps <n>             simulation steps per grid and mode (default 2000)
+//   --threads <n>,...       step thread counts of the scaling table (default 1,2,4)
+
+void print_usage()
+{
+	std::cout << "usage: dynamic_mm_bench [--max-size <n>] [--steps <n>] [--threads <n>,...] [<config>...]" << std::endl;
+}
+
+struct StepResult {
+	double msPerStep = 0;
+	// joint positions after the last step
+	vector<cpVect> joints;
+};
+
+// milliseconds per step of an n x n grid
+StepResult time_steps(int n, int steps, bool collisions, int stepThreads = 1, bool gridSolver = false)
+{
+	MMGrid grid(n, n, vector<int>(n * n, 0));
+	grid.setCollisions(collisions);
+	grid.setStepThreads(stepThreads);
+	grid.setGridSolver(gridSolver);
+	for (int c = 0; c <= n; c++)
+		grid.anchor(c);
+	int target = (n + 1) * (n + 1) - 1;
+	cpVect center = grid.getRestPosition(target) - cpv(0.5, 0);
+	vector<cpVect> circle;
+	for (int p = 0; p < 12; p++)
+		circle.push_back(center + cpv(0.5 * cos(p * M_PI / 6), 0.5 * sin(p * M_PI / 6)));
+	grid.setTargetPaths({ target }, { circle });
+
+	double timeStep = 0.5 / 60;
+	int pathStepsPerSec = 3;
+	auto start = std::chrono::steady_clock::now();
+	for (int s = 0; s < steps; s++)
+		grid.update_follow_path(timeStep, pathStepsPerSec);
+	auto end = std::chrono::steady_clock::now();
+	StepResult result;
+	result.msPerStep = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+	for (int j = 0; j < (n + 1) * (n + 1); j++)
+		result.joints.push_back(grid.getPos(j));
+	return result;
+}
+
+struct ProfileResult {
+	double msPerStep = 0;
+	long steps = 0;
+	double pathError = 0;
+	vector<vector<cpVect>> calculatedPaths;
+};
+
+ProfileResult evaluate_profile(std::string config, SimulationProfile profile, int stepThreads = 1, bool gridSolver = false)
+{
+	MMGrid grid(1, 1, { 0 });
+	grid.loadFromFile(config);
+	grid.setProfile(profile);
+	grid.setStepThreads(stepThreads);
+	grid.setGridSolver(gridSolver);
+	ProfileResult result;
+	auto start = std::chrono::steady_clock::now();
+	result.pathError = grid.getPathError();
+	auto end = std::chrono::steady_clock::now();
+	result.steps = grid.getLastIterations();
+	result.msPerStep = std::chrono::duration<double, std::milli>(end - start).count() / std::max<long>(1, result.steps);
+	result.calculatedPaths = grid.getCalculatedPaths();
+	return result;
+}
+
+// largest distance between the two runs' target joints at the same path point
+double max_deviation(const vector<vector<cpVect>>& a, const vector<vector<cpVect>>& b)
+{
+	double deviation = 0;
+	for (int t = 0; t < std::min(a.size(), b.size()); t++)
+		for (int p = 0; p < std::min(a[t].size(), b[t].size()); p++)
+			deviation = std::max(deviation, cpvdist(a[t][p], b[t][p]));
+	return deviation;
+}
+
+int main(int argc, char* argv[])
+{
+	int maxSize = 32;
+	int steps = 2000;
+	vector<int> threadCounts = { 1, 2, 4 };
+	vector<std::string> configs;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--max-size" && hasValue) {
+			maxSize = std::atoi(argv[++i]);
+		}
+		else if (arg == "--steps" && hasValue) {
+			steps = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--threads" && hasValue) {
+			threadCounts.clear();
+			std::string list = argv[++i];
+			for (size_t begin = 0; begin <= list.size();)
+			{
+				size_t end = std::min(list.find(',', begin), list.size());
+				threadCounts.push_back(std::max(1, std::atoi(list.substr(begin, end - begin).c_str())));
+				begin = end + 1;
+			}
+		}
+		else if (arg.rfind("--", 0) != 0) {
+			configs.push_back(arg);
+		}
+		else {
+			std::cout << "unknown or incomplete option " << arg << std::endl;
+			print_usage();
+			return 1;
+		}
+	}
+
+	vector<std::string> rows;
+	for (int n = 2; n <= maxSize; n *= 2)
+	{
+		double without = time_steps(n, steps, false).msPerStep;
+		double with = time_steps(n, steps, true).msPerStep;
+		rows.push_back(std::to_string(n) + "x" + std::to_string(n) + "\t" + std::to_string(without) + "\t" + std::to_string(with) +
+			"\t" + std::to_string(with / without));
+	}
+	for (int n = 2; n <= maxSize; n *= 2)
+	{
+		double single = 0;
+		vector<cpVect> reference;
+		for (int threads : threadCounts)
+		{
+			StepResult result = time_steps(n, steps, false, threads);
+			if (threads == 1)
+				single = result.msPerStep;
+			std::string deviation = "-";
+			if (threads > 1 && reference.empty())
+				reference = result.joints;
+			else if (threads > 1)
+				deviation = std::to_string(max_deviation({ result.joints }, { reference }));
+			rows.push_back(std::to_string(n) + "x" + std::to_string(n) + "\t" + std::to_string(threads) + "\t" +
+				std::to_string(1000 / result.msPerStep) + "\t" + (single > 0 ? std::to_string(single / result.msPerStep) : "-") + "\t" + deviation);
+		}
+	}
+	for (int n = 2; n <= maxSize; n *= 2)
+	{
+		StepResult chipmunk = time_steps(n, steps, false);
+		StepResult colored = time_steps(n, steps, false, 2);
+		StepResult soa = time_steps(n, steps, false, 1, true);
+		rows.push_back(std::to_string(n) + "x" + std::to_string(n) + "\t" + std::to_string(chipmunk.msPerStep) + "\t" + std::to_string(soa.msPerStep) +
+			"\t" + std::to_string(chipmunk.msPerStep / soa.msPerStep) + "\t" + std::to_string(max_deviation({ soa.joints }, { chipmunk.joints })) +
+			"\t" + std::to_string(max_deviation({ soa.joints }, { colored.joints })));
+	}
+	for (std::string& config : configs)
+	{
+		ProfileResult reference = evaluate_profile(config, SimulationProfile::accurateVerify());
+		for (std::string name : SimulationProfile::names())
+		{
+			SimulationProfile profile;
+			SimulationProfile::byName(name, profile);
+			ProfileResult result = name == "accurate" ? reference : evaluate_profile(config, profile);
+			rows.push_back(config + " " + name + "\t" + std::to_string(result.msPerStep) + "\t" + std::to_string(result.steps) + "\t" +
+				std::to_string(result.pathError) + "\t" + std::to_string(std::abs(result.pathError - reference.pathError)) + "\t" +
+				std::to_string(max_deviation(result.calculatedPaths, reference.calculatedPaths)));
+		}
+		ProfileResult chipmunk = evaluate_profile(config, SimulationProfile());
+		ProfileResult colored = evaluate_profile(config, SimulationProfile(), 2);
+		ProfileResult soa = evaluate_profile(config, SimulationProfile(), 1, true);
+		rows.push_back(config + " default (2 step threads)\t" + std::to_string(colored.msPerStep) + "\t" + std::to_string(colored.steps) + "\t" +
+			std::to_string(colored.pathError) + "\t" + std::to_string(std::abs(colored.pathError - chipmunk.pathError)) + "\t" +
+			std::to_string(max_deviation(colored.calculatedPaths, chipmunk.calculatedPaths)));
+		rows.push_back(config + " default (grid solver)\t" + std::to_string(soa.msPerStep) + "\t" + std::to_string(soa.steps) + "\t" +
+			std::to_string(soa.pathError) + "\t" + std::to_string(std::abs(soa.pathError - colored.pathError)) + "\t" +
+			std::to_string(max_deviation(soa.calculatedPaths, colored.calculatedPaths)));
+	}
+
+	// after the grids' own output
+	int r = 0;
+	std::cout << "grid\tms/step without collisions\tms/step with collisions\tratio" << std::endl;
+	for (int n = 2; n <= maxSize; n *= 2)
+		std::cout << rows[r++] << std::endl;
+	std::cout << std::endl << "grid\tstep threads\tsteps/s\tspeedup\tmax joint deviation (from the first multithreaded run)" << std::endl;
+	for (int n = 2; n <= maxSize; n *= 2)
+		for (int t = 0; t < threadCounts.size(); t++)
+			std::cout << rows[r++] << std::endl;
+	std::cout << std::endl << "grid\tms/step cpSpaceStep\tms/step grid solver\tspeedup\tmax joint deviation from cpSpaceStep\tfrom 2 step threads" << std::endl;
+	for (int n = 2; n <= maxSize; n *= 2)
+		std::cout << rows[r++] << std::endl;
+	if (!configs.empty())
+	{
+		std::cout << std::endl << "config profile\tms/step\tsteps\tpath error\terror deviation\tmax path deviation (from accurate; 2 step threads from default; grid solver from 2 step threads)" << std::endl;
+		while (r < rows.size())
+			std::cout << rows[r++] << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include "BackgroundOptimizer.hpp"
+
+BackgroundOptimizer::BackgroundOptimizer() : cancelFlag(false), running(false), iteration(0), numIterations(0), bestError(0) {}
+
+BackgroundOptimizer::~BackgroundOptimizer()
+{
+    cancelFlag = true;
+    if (worker.joinable())
+        worker.join();
+}
+
+void BackgroundOptimizer::start(std::vector<MMGrid>& gridSet, double pathWeight, double dofWeight, int numIterations, int numCandidates, FitnessCache* cache)
+{
+    if (running)
+        return;
+    if (worker.joinable())
+        worker.join();
+    cancelFlag = false;
+    iteration = 0;
+    this->numIterations = numIterations;
+    {
+        std::lock_guard<std::mutex> lock(handoffMutex);
+        published = false;
+        finished = false;
+    }
+    sa = std::make_unique<SimulatedAnnealingSet>(gridSet, dofWeight, pathWeight);
+    sa->setCache(cache);
+    sa->setCandidatesPerIteration(numCandidates);
+    sa->setCancelFlag(&cancelFlag);
+    running = true;
+    worker = std::thread([this, numIterations]() {
+        OptimizerSnapshot back;
+        sa->setProgressCallback([this, &back](int done, int total, bool improved) {
+            iteration = done;
+            bestError = sa->getBestError();
+            if (improved)
+            {
+                back.cells = sa->getBestCells();
+                back.error = sa->getBestError();
+                back.calculatedPaths = sa->getCalculatedPaths();
+                publish(back, false);
+            }
+        });
+        MMGrid best = sa->simulate(numIterations);
+        back.cells = best.getCells();
+        back.error = sa->getBestError();
+        back.calculatedPaths = sa->getCalculatedPaths();
+        bestError = back.error;
+        publish(back, true);
+        running = false;
+    });
+}
+
+void BackgroundOptimizer::publish(OptimizerSnapshot& back, bool done)
+{
+    // only a swap under the lock, the copies were made beforehand
+    std::lock_guard<std::mutex> lock(handoffMutex);
+    std::swap(back, shared);
+    published = true;
+    finished = finished || done;
+}
+
+bool BackgroundOptimizer::poll(OptimizerSnapshot& front, bool& done)
+{
+    std::unique_lock<std::mutex> lock(handoffMutex, std::try_to_lock);
+    if (!lock.owns_lock() || !published)
+        return false;
+    std::swap(front, shared);
+    published = false;
+    done = finished;
+    return true;
+}
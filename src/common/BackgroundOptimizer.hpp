@@ -0,0 +1,49 @@
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "SimulatedAnnealingSet.hpp"
+
+#pragma once
+
+// Best layout found so far, handed from the annealing thread to the UI.
+struct OptimizerSnapshot {
+    vector<int> cells;
+    double error = 0;
+    vector<vector<vector<cpVect>>> calculatedPaths;
+};
+
+// Runs SimulatedAnnealingSet on a worker thread so the viewer keeps drawing.
+// New best layouts are published through a double buffer: the worker swaps its back buffer in under
+// a short lock, the render loop only try_locks and skips a frame instead of waiting.
+class BackgroundOptimizer {
+    private:
+        std::thread worker;
+        std::unique_ptr<SimulatedAnnealingSet> sa;
+        std::atomic<bool> cancelFlag;
+        std::atomic<bool> running;
+        std::atomic<int> iteration;
+        std::atomic<int> numIterations;
+        std::atomic<double> bestError;
+        std::mutex handoffMutex;
+        OptimizerSnapshot shared;
+        bool published = false;
+        bool finished = false;
+        void publish(OptimizerSnapshot& back, bool done);
+    public:
+        BackgroundOptimizer();
+        ~BackgroundOptimizer();
+        BackgroundOptimizer(const BackgroundOptimizer&) = delete;
+        BackgroundOptimizer& operator=(const BackgroundOptimizer&) = delete;
+        // copies gridSet, then anneals it on the worker thread with numCandidates mutations per iteration; ignored while
+        // a run is in progress
+        void start(std::vector<MMGrid>& gridSet, double pathWeight, double dofWeight, int numIterations, int numCandidates, FitnessCache* cache);
+        // the worker stops after its current iteration and publishes the best layout so far
+        void cancel() { cancelFlag = true; };
+        bool isRunning() { return running; };
+        float progress() { return numIterations > 0 ? (float)iteration / numIterations : 0.f; };
+        int getIteration() { return iteration; };
+        double getBestError() { return bestError; };
+        // non-blocking: moves a newly published snapshot into front and returns true, done is set for the final one
+        bool poll(OptimizerSnapshot& front, bool& done);
+};
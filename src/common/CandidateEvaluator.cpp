@@ -0,0 +1,411 @@
+#include "CandidateEvaluator.hpp"
+#include <algorithm>
+
+CandidateEvaluator::CandidateEvaluator(std::vector<MMGrid>& pathSets, double pathWeight, double dofWeight, int numThreads) : pathSets(pathSets), pathWeight(pathWeight), dofWeight(dofWeight), evaluated(0), aborted(0), prescreened(0),
+    warmIterations(0), warmPoints(0), coldIterations(0), coldPoints(0)
+{
+    seeds.resize(pathSets.size());
+    for (MMGrid& grid : pathSets)
+        screens.push_back(FeasibilityCheck(grid));
+    scratch.resize(pathSets.size());
+    if (numThreads <= 0)
+        numThreads = std::min<int>(pathSets.size(), std::max(1u, std::thread::hardware_concurrency()));
+    if (numThreads > 1)
+        pool = std::make_unique<ThreadPool>(numThreads);
+}
+
+void CandidateEvaluator::setCache(FitnessCache* cache)
+{
+    this->cache = cache;
+    if (cache)
+        contextKey = solverContextKey();
+}
+
+void CandidateEvaluator::setPersistentCache(PersistentCache* store)
+{
+    this->store = store && store->isOpen() ? store : nullptr;
+    if (this->store)
+        contextHash = PersistentCache::hash(solverContextKey());
+}
+
+std::string CandidateEvaluator::solverContextKey(std::vector<MMGrid>& pathSets, bool quasiStatic, bool warmStart)
+{
+    // the quasi-static solver never uses seeds
+    return FitnessCache::contextKey(pathSets) + (quasiStatic ? "qs" : (warmStart ? "warm" : ""));
+}
+
+void CandidateEvaluator::setWarmStart(bool warmStart)
+{
+    this->warmStart = warmStart;
+    setCache(cache);
+    setPersistentCache(store);
+}
+
+void CandidateEvaluator::setQuasiStatic(bool quasiStatic)
+{
+    this->quasiStatic = quasiStatic;
+    setCache(cache);
+    setPersistentCache(store);
+}
+
+double CandidateEvaluator::evaluatePathSet(int setIndex, vector<int>& cells, vector<vector<cpVect>>& calculatedPaths, double pathBudget, vector<vector<cpFloat>>* poses)
+{
+    if (quasiStatic)
+    {
+        // the solver keeps no state between evaluations, so it is cheap to set up per path set
+        QuasiStaticSolver solver(pathSets[setIndex]);
+        double pathErr = solver.getPathError(cells, pathBudget);
+        calculatedPaths = solver.getCalculatedPaths();
+        return pathErr;
+    }
+    std::unique_ptr<MMGrid> grid = acquireGrid(setIndex);
+    grid->applyCells(cells);
+    bool seeded = false;
+    if (warmStart)
+    {
+        std::lock_guard<std::mutex> lock(posesMutex);
+        seeded = !seeds[setIndex].empty();
+        grid->setWarmStart(seeds[setIndex]);
+    }
+    double pathErr = grid->getPathError(pathBudget);
+    calculatedPaths = grid->getCalculatedPaths();
+    // the first path point is never simulated
+    long points = calculatedPaths.empty() ? 0 : std::max<long>(0, calculatedPaths[0].size() - 1);
+    (seeded ? warmIterations : coldIterations) += grid->getLastIterations();
+    (seeded ? warmPoints : coldPoints) += points;
+    if (poses)
+        *poses = grid->getConvergedPoses();
+    recordConvergence(grid->getPointConvergence());
+    releaseGrid(setIndex, std::move(grid));
+    return pathErr;
+}
+
+std::unique_ptr<MMGrid> CandidateEvaluator::acquireGrid(int setIndex)
+{
+    {
+        std::lock_guard<std::mutex> lock(scratchMutex);
+        if (!scratch[setIndex].empty())
+        {
+            std::unique_ptr<MMGrid> grid = std::move(scratch[setIndex].back());
+            scratch[setIndex].pop_back();
+            return grid;
+        }
+    }
+    // one per concurrent evaluation of this path set, built once
+    return std::make_unique<MMGrid>(pathSets[setIndex]);
+}
+
+void CandidateEvaluator::releaseGrid(int setIndex, std::unique_ptr<MMGrid> grid)
+{
+    std::lock_guard<std::mutex> lock(scratchMutex);
+    scratch[setIndex].push_back(std::move(grid));
+}
+
+Evaluation CandidateEvaluator::evaluate(vector<int> cells)
+{
+    return evaluate(cells, DBL_MAX);
+}
+
+void CandidateEvaluator::setRemote(RemoteEvaluator* remote)
+{
+    this->remote = remote;
+    remoteContexts.clear();
+    if (remote)
+    {
+        for (MMGrid& grid : pathSets)
+            remoteContexts.push_back(WorkerProtocol::encodeContext(grid));
+    }
+}
+
+bool CandidateEvaluator::settle(vector<int>& cells, double budget, Evaluation& result, Pending& pending)
+{
+    int rows = pathSets[0].getRows(), cols = pathSets[0].getCols();
+    std::string designKey;
+    if (cache || store)
+        designKey = FitnessCache::designKey(rows, cols, cells);
+    if (cache)
+    {
+        pending.key = contextKey + designKey;
+        if (cache->lookup(pending.key, result))
+        {
+            result.error = result.pathError * pathWeight + result.dofs * dofWeight;
+            return true;
+        }
+    }
+    if (store)
+    {
+        pending.designHash = PersistentCache::hash(designKey);
+        if (store->lookup(pending.designHash, contextHash, result))
+        {
+            // records written without paths still get one (empty) slot per path set
+            result.calculatedPaths.resize(pathSets.size());
+            if (cache)
+                cache->insert(pending.key, result);
+            result.error = result.pathError * pathWeight + result.dofs * dofWeight;
+            return true;
+        }
+    }
+    // the DOF term is exact and cheap, what is left of the budget goes to the path error
+    ConstraintGraph cg(rows, cols, cells);
+    result.dofs = cg.dofs();
+    pending.pathBudget = DBL_MAX;
+    if (budget < DBL_MAX && pathWeight > 0)
+        pending.pathBudget = (budget - result.dofs * dofWeight) / pathWeight;
+    evaluated++;
+    result.calculatedPaths.resize(pathSets.size());
+    if (pending.pathBudget < 0)
+    {
+        // over budget without simulating anything
+        result.pathError = 0;
+        result.error = result.dofs * dofWeight;
+        result.aborted = true;
+        aborted++;
+        return true;
+    }
+    if (prescreen)
+    {
+        double bound = 0;
+        bool allImmobile = true;
+        for (FeasibilityCheck& screen : screens)
+        {
+            bool immobile;
+            bound += screen.pathErrorBound(cells, immobile);
+            allImmobile = allImmobile && immobile;
+        }
+        if (allImmobile)
+        {
+            // the targets stay at rest, which is all a simulation would find: a complete result, cached like one
+            prescreened++;
+            result.pathError = bound;
+            for (int s = 0; s < screens.size(); s++)
+                result.calculatedPaths[s] = screens[s].restPaths();
+            finish(result, pending);
+            return true;
+        }
+        if (bound > pending.pathBudget)
+        {
+            // the targets can't get close enough, no need to simulate
+            prescreened++;
+            result.pathError = bound;
+            result.error = result.pathError * pathWeight + result.dofs * dofWeight;
+            result.aborted = true;
+            aborted++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CandidateEvaluator::complete(const Evaluation& result)
+{
+    for (int s = 0; s < pathSets.size(); s++)
+    {
+        vector<vector<cpVect>> targetPaths = pathSets[s].getTargetPaths();
+        if (result.calculatedPaths[s].size() != targetPaths.size())
+            return false;
+        for (int t = 0; t < targetPaths.size(); t++)
+            if (result.calculatedPaths[s][t].size() != targetPaths[t].size())
+                return false;
+    }
+    return true;
+}
+
+void CandidateEvaluator::finish(Evaluation& result, Pending& pending)
+{
+    result.error = result.pathError * pathWeight + result.dofs * dofWeight;
+    // path sets evaluated concurrently each get the whole budget, so the total can exceed it with every path set
+    // simulated to the end; such a result is as exact as any other
+    if (!complete(result))
+    {
+        result.aborted = true;
+        aborted++;
+        return;
+    }
+    if (cache)
+        cache->insert(pending.key, result);
+    if (store)
+        store->append(pending.designHash, contextHash, result);
+}
+
+Evaluation CandidateEvaluator::evaluate(vector<int> cells, double budget)
+{
+    return evaluateBatch({ cells }, budget)[0];
+}
+
+void CandidateEvaluator::simulateLocally(std::vector<vector<int>>& candidates, const std::vector<int>& unsettled, std::vector<Evaluation>& results, std::vector<Pending>& pending)
+{
+    bool keepPoses = warmStart && !quasiStatic;
+    std::vector<std::vector<vector<vector<cpFloat>>>> poses(candidates.size());
+    for (int c : unsettled)
+        poses[c].resize(pathSets.size());
+    if (pool)
+    {
+        // all path sets of all candidates run concurrently, so each one can only be checked against its candidate's
+        // whole budget
+        std::vector<std::future<double>> pathErrs;
+        for (int c : unsettled)
+        {
+            for (int s = 0; s < pathSets.size(); s++)
+            {
+                pathErrs.push_back(pool->submit([this, c, s, &candidates, &results, &pending, &poses, keepPoses]() {
+                    return evaluatePathSet(s, candidates[c], results[c].calculatedPaths[s], pending[c].pathBudget, keepPoses ? &poses[c][s] : nullptr);
+                }));
+            }
+        }
+        int j = 0;
+        for (int c : unsettled)
+            for (int s = 0; s < pathSets.size(); s++)
+                results[c].pathError += pathErrs[j++].get();
+    }
+    else
+    {
+        for (int c : unsettled)
+        {
+            for (int s = 0; s < pathSets.size() && results[c].pathError <= pending[c].pathBudget; s++)
+                results[c].pathError += evaluatePathSet(s, candidates[c], results[c].calculatedPaths[s], pending[c].pathBudget - results[c].pathError, keepPoses ? &poses[c][s] : nullptr);
+        }
+    }
+    for (int c : unsettled)
+    {
+        finish(results[c], pending[c]);
+        if (keepPoses && !results[c].aborted)
+        {
+            std::lock_guard<std::mutex> lock(posesMutex);
+            candidatePoses[FitnessCache::designKey(pathSets[0].getRows(), pathSets[0].getCols(), candidates[c])] = poses[c];
+        }
+    }
+}
+
+void CandidateEvaluator::accept(const vector<int>& cells)
+{
+    if (!warmStart)
+        return;
+    std::lock_guard<std::mutex> lock(posesMutex);
+    auto it = candidatePoses.find(FitnessCache::designKey(pathSets[0].getRows(), pathSets[0].getCols(), cells));
+    // a layout that came from the cache keeps the previous seeds
+    if (it != candidatePoses.end())
+        seeds = it->second;
+    candidatePoses.clear();
+}
+
+void CandidateEvaluator::reseed(vector<int> cells)
+{
+    if (!warmStart || quasiStatic)
+        return;
+    std::vector<vector<vector<cpFloat>>> poses(pathSets.size());
+    for (int s = 0; s < pathSets.size(); s++)
+    {
+        vector<vector<cpVect>> calculatedPaths;
+        evaluatePathSet(s, cells, calculatedPaths, DBL_MAX, &poses[s]);
+    }
+    std::lock_guard<std::mutex> lock(posesMutex);
+    seeds = poses;
+    candidatePoses.clear();
+}
+
+void CandidateEvaluator::printWarmStartStats()
+{
+    if (!warmStart)
+        return;
+    double warm = warmPoints > 0 ? (double)warmIterations / warmPoints : 0;
+    double cold = coldPoints > 0 ? (double)coldIterations / coldPoints : 0;
+    std::cout << "Warm start: " << warm << " simulation steps per path point over " << warmPoints << " seeded points, "
+        << cold << " over " << coldPoints << " unseeded ones";
+    if (warmPoints > 0 && coldPoints > 0)
+        std::cout << " (about " << (long)((cold - warm) * warmPoints) << " steps saved)";
+    std::cout << std::endl;
+}
+
+void CandidateEvaluator::recordConvergence(const vector<PointConvergence>& points)
+{
+    std::lock_guard<std::mutex> lock(convergenceMutex);
+    if (pointSteps.size() < points.size())
+    {
+        pointSteps.resize(points.size(), 0);
+        pointSamples.resize(points.size(), 0);
+        pointUnsettled.resize(points.size(), 0);
+    }
+    for (int p = 0; p < points.size(); p++)
+    {
+        // the first path point (and any the playback skipped) took no steps
+        if (points[p].steps == 0)
+            continue;
+        pointSteps[p] += points[p].steps;
+        pointSamples[p]++;
+        pointUnsettled[p] += points[p].settled ? 0 : 1;
+        maxPointSteps = std::max(maxPointSteps, points[p].steps);
+    }
+}
+
+void CandidateEvaluator::printConvergenceStats()
+{
+    std::lock_guard<std::mutex> lock(convergenceMutex);
+    long steps = 0, samples = 0, unsettled = 0;
+    for (int p = 0; p < pointSteps.size(); p++)
+    {
+        steps += pointSteps[p];
+        samples += pointSamples[p];
+        unsettled += pointUnsettled[p];
+    }
+    if (samples == 0)
+        return;
+    std::cout << "Convergence: " << (double)steps / samples << " simulation steps per path point (at most " << maxPointSteps << "), "
+        << unsettled << " of " << samples << " points moved on before settling" << std::endl;
+    std::cout << "Steps per path point:";
+    for (int p = 0; p < pointSteps.size(); p++)
+        std::cout << " " << (pointSamples[p] > 0 ? (double)pointSteps[p] / pointSamples[p] : 0);
+    std::cout << std::endl;
+}
+
+std::vector<Evaluation> CandidateEvaluator::evaluateBatch(std::vector<vector<int>> candidates, double budget)
+{
+    std::vector<Evaluation> results(candidates.size());
+    std::vector<Pending> pending(candidates.size());
+    std::vector<int> unsettled;
+    for (int c = 0; c < candidates.size(); c++)
+    {
+        if (!settle(candidates[c], budget, results[c], pending[c]))
+            unsettled.push_back(c);
+    }
+    if (unsettled.empty())
+        return results;
+    if (!remote || quasiStatic)
+    {
+        simulateLocally(candidates, unsettled, results, pending);
+        return results;
+    }
+
+    // one job per candidate and path set, each checked against the candidate's whole path budget
+    std::vector<WorkerProtocol::Request> requests;
+    std::vector<std::pair<int, int>> jobs;
+    for (int c : unsettled)
+    {
+        for (int s = 0; s < pathSets.size(); s++)
+        {
+            WorkerProtocol::Request request;
+            request.context = remoteContexts[s];
+            request.cells = candidates[c];
+            request.pathBudget = pending[c].pathBudget;
+            requests.push_back(request);
+            jobs.push_back(std::make_pair(c, s));
+        }
+    }
+
+    std::vector<WorkerProtocol::Reply> replies;
+    std::vector<bool> done;
+    remote->run(requests, replies, done);
+    for (int j = 0; j < jobs.size(); j++)
+    {
+        int c = jobs[j].first, s = jobs[j].second;
+        if (done[j])
+        {
+            results[c].pathError += replies[j].pathError;
+            results[c].calculatedPaths[s] = replies[j].calculatedPaths;
+        }
+        else
+            results[c].pathError += evaluatePathSet(s, candidates[c], results[c].calculatedPaths[s], pending[c].pathBudget);
+    }
+    for (int c : unsettled)
+        finish(results[c], pending[c]);
+    return results;
+}
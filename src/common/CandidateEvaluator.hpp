@@ -0,0 +1,111 @@
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "MMGrid.hpp"
+#include "FitnessCache.hpp"
+#include "PersistentCache.hpp"
+#include "FeasibilityCheck.hpp"
+#include "ThreadPool.hpp"
+#include "RemoteEvaluator.hpp"
+#include "QuasiStaticSolver.hpp"
+
+#pragma once
+
+// Scores a cell layout against every path set (same layout, different anchors/targets).
+// The path sets are independent simulations, so each one runs on its own copy of the grid and thread.
+class CandidateEvaluator {
+    private:
+        std::vector<MMGrid>& pathSets;
+        double pathWeight;
+        double dofWeight;
+        std::unique_ptr<ThreadPool> pool;
+        FitnessCache* cache = nullptr;
+        std::string contextKey;
+        PersistentCache* store = nullptr;
+        uint64_t contextHash = 0;
+        std::atomic<long> evaluated;
+        std::atomic<long> aborted;
+        std::vector<FeasibilityCheck> screens;
+        // idle simulation grids per path set, reused through MMGrid::applyCells instead of copied per candidate
+        std::vector<std::vector<std::unique_ptr<MMGrid>>> scratch;
+        std::mutex scratchMutex;
+        std::unique_ptr<MMGrid> acquireGrid(int setIndex);
+        void releaseGrid(int setIndex, std::unique_ptr<MMGrid> grid);
+        bool prescreen = true;
+        std::atomic<long> prescreened;
+        double evaluatePathSet(int setIndex, vector<int>& cells, vector<vector<cpVect>>& calculatedPaths, double pathBudget = DBL_MAX, vector<vector<cpFloat>>* poses = nullptr);
+        // converged link poses per path set: of the accepted design (seeds) and of this round's candidates
+        bool warmStart = false;
+        std::mutex posesMutex;
+        std::vector<vector<vector<cpFloat>>> seeds;
+        std::unordered_map<std::string, std::vector<vector<vector<cpFloat>>>> candidatePoses;
+        std::atomic<long> warmIterations, warmPoints, coldIterations, coldPoints;
+        // simulation steps, simulated points and unsettled points per path point index, over all local simulations
+        std::mutex convergenceMutex;
+        std::vector<long> pointSteps, pointSamples, pointUnsettled;
+        int maxPointSteps = 0;
+        void recordConvergence(const vector<PointConvergence>& points);
+        RemoteEvaluator* remote = nullptr;
+        std::vector<std::string> remoteContexts;
+        bool quasiStatic = false;
+        std::string solverContextKey() { return solverContextKey(pathSets, quasiStatic, warmStart); };
+        // what is left to do for a candidate the caches and the prescreen could not settle
+        struct Pending {
+            std::string key;
+            uint64_t designHash = 0;
+            double pathBudget = DBL_MAX;
+        };
+        // true if result is final without simulating
+        bool settle(vector<int>& cells, double budget, Evaluation& result, Pending& pending);
+        // whether every path set was simulated up to its last path point
+        bool complete(const Evaluation& result);
+        void finish(Evaluation& result, Pending& pending);
+        // simulates the path sets of candidates[unsettled] here, all at once if there is a pool, and finishes them
+        void simulateLocally(std::vector<vector<int>>& candidates, const std::vector<int>& unsettled, std::vector<Evaluation>& results, std::vector<Pending>& pending);
+    public:
+        // cache context of the path sets, tagged with the solver (and warm starts, which change simulated results) so
+        // they never share results; checkpoints are keyed the same way
+        static std::string solverContextKey(std::vector<MMGrid>& pathSets, bool quasiStatic, bool warmStart = false);
+        // numThreads <= 0 uses one thread per path set, 1 evaluates serially; evaluateBatch can keep
+        // (candidates x path sets) threads busy
+        CandidateEvaluator(std::vector<MMGrid>& pathSets, double pathWeight, double dofWeight, int numThreads = 0);
+        // consult (and fill) cache before simulating; the cache may be shared between evaluators and threads
+        void setCache(FitnessCache* cache);
+        // on-disk store consulted after cache and appended to after every simulation
+        void setPersistentCache(PersistentCache* store);
+        Evaluation evaluate(vector<int> cells);
+        // only needs to know whether the weighted error stays at or below budget: simulation of a
+        // path set stops once the error is known to exceed it, the result is then marked aborted (a result that
+        // was simulated to the end is not, even when it ends up over the budget)
+        Evaluation evaluate(vector<int> cells, double budget);
+        // several candidates against the same budget; their path sets are all simulated at once, by the workers with a
+        // remote evaluator (anything they fail to deliver locally) or else on the thread pool, serially without one
+        std::vector<Evaluation> evaluateBatch(std::vector<vector<int>> candidates, double budget = DBL_MAX);
+        // simulate on dynamic_mm_worker processes instead of locally (nullptr to stop)
+        void setRemote(RemoteEvaluator* remote);
+        // simulate every path point starting from where the accepted design converged at that point (see accept)
+        // rather than from the previous point; results then depend on the seeds, so cached errors are approximate
+        void setWarmStart(bool warmStart);
+        // once per iteration with the current layout: its converged poses, if it was simulated since the last call,
+        // seed the next candidates; the poses of the other candidates are dropped
+        void accept(const vector<int>& cells);
+        // simulates cells regardless of the caches and seeds the next candidates with its poses, for a layout
+        // whose simulation happened elsewhere (a resumed checkpoint)
+        void reseed(vector<int> cells);
+        // average simulation steps per path point with and without seeds
+        void printWarmStartStats();
+        // steps per path point and how many points moved on before settling (see MMGrid::setConvergence)
+        void printConvergenceStats();
+        // solve each path point's equilibrium with QuasiStaticSolver instead of simulating the dynamics; always
+        // local, remote workers and warm starts only apply to the simulation
+        void setQuasiStatic(bool quasiStatic);
+        // bound layouts with FeasibilityCheck before simulating (on by default): layouts whose bound exceeds the
+        // budget are aborted, layouts that can't move any target joint get their (fixed) error without a simulation
+        void setPrescreen(bool prescreen) { this->prescreen = prescreen; };
+        // simulations avoided by the prescreen (included in getAborted when over budget)
+        long getPrescreened() { return prescreened; };
+        long getAborted() { return aborted; };
+        long getEvaluated() { return evaluated; };
+        int numPathSets() { return pathSets.size(); };
+};
@@ -115,7 +115,7 @@ void ConstraintGraph::splitComponents()
 {
     vector<int> cellIndices = makeCellIndices();
     vector<int> cells(rows*cols);
-    int skip = cellIndices[rand() % cellIndices.size()];
+    int skip = cellIndices[randomInt(cellIndices.size())];
     for (int i = 0; i < rows; i++)
     {
         rowConstraints[i] = i + 1;
@@ -131,6 +131,23 @@ void ConstraintGraph::splitComponents()
     }
 }
 
+// random merge or split, as used by the annealers
+void ConstraintGraph::mutate()
+{
+    if (randomInt(2) == 0 && dofs() > 1)
+    {
+        mergeComponents();
+    }
+    else if (dofs() == rows + cols)
+    {
+        mergeComponents();
+    }
+    else
+    {
+        splitComponents();
+    }
+}
+
 int ConstraintGraph::dofs()
 {
     int dofs = 0;
@@ -142,6 +159,73 @@ int ConstraintGraph::dofs()
     return dofs;
 }
 
+vector<int> ConstraintGraph::canonicalConstraints()
+{
+    vector<int> result = getAllConstraints();
+    vector<int> labels(rows + 1);
+    int nextLabel = 1;
+    for (int& c : result)
+    {
+        if (c == 0)
+            continue;
+        if (labels[c] == 0)
+            labels[c] = nextLabel++;
+        c = labels[c];
+    }
+    return result;
+}
+
+// assigns rows then columns to blocks (restricted growth order, so each partition comes up once)
+static void enumerateBlocks(int rows, int cols, int element, vector<int>& block, vector<int>& blockRows, vector<int>& blockCols, vector<ConstraintGraph>& result)
+{
+    int n = rows + cols;
+    if (element == n)
+    {
+        for (int b = 0; b < blockRows.size(); b++)
+        {
+            if (blockRows[b] + blockCols[b] > 1 && (blockRows[b] == 0 || blockCols[b] == 0))
+                return;
+        }
+        // same labels tieRC uses: the lowest row of a group + 1, 0 for a column on its own
+        vector<int> rowConstraints(rows), colConstraints(cols);
+        vector<int> blockLabel(blockRows.size());
+        for (int r = rows - 1; r >= 0; r--)
+            blockLabel[block[r]] = r + 1;
+        for (int r = 0; r < rows; r++)
+            rowConstraints[r] = blockLabel[block[r]];
+        for (int c = 0; c < cols; c++)
+            colConstraints[c] = blockLabel[block[rows + c]];
+        result.push_back(ConstraintGraph(rowConstraints, colConstraints));
+        return;
+    }
+    bool isRow = element < rows;
+    for (int b = 0; b <= blockRows.size(); b++)
+    {
+        if (b == blockRows.size())
+        {
+            blockRows.push_back(0);
+            blockCols.push_back(0);
+        }
+        (isRow ? blockRows : blockCols)[b]++;
+        block[element] = b;
+        enumerateBlocks(rows, cols, element + 1, block, blockRows, blockCols, result);
+        (isRow ? blockRows : blockCols)[b]--;
+        if (blockRows[b] + blockCols[b] == 0)
+        {
+            blockRows.pop_back();
+            blockCols.pop_back();
+        }
+    }
+}
+
+vector<ConstraintGraph> ConstraintGraph::enumeratePartitions(int rows, int cols)
+{
+    vector<ConstraintGraph> result;
+    vector<int> block(rows + cols), blockRows, blockCols;
+    enumerateBlocks(rows, cols, 0, block, blockRows, blockCols, result);
+    return result;
+}
+
 vector<int> ConstraintGraph::makeCellIndices() {
     //this should return a minimal (non-redundant) configuration of rigid cells to get the current constraint graph
     vector<int> result;
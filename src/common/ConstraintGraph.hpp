@@ -30,8 +30,15 @@ public:
         return allConstraints;
     }
     int dofs();
+    // row then column constraints relabelled in order of first appearance (0 stays "unconstrained"),
+    // equal for every cell layout with the same partition
+    vector<int> canonicalConstraints();
+    // every partition tieRC can produce, once each: blocks are single rows, single (unconstrained) columns
+    // or groups with at least one row and one column
+    static vector<ConstraintGraph> enumeratePartitions(int rows, int cols);
     void mergeComponents();
     void splitComponents();
+    void mutate();
     vector<int> makeCells();
     vector<int> makeCellIndices();
     vector<int> allConstrainedIndices();
@@ -0,0 +1,75 @@
+#include "ExhaustiveSearch.hpp"
+#include <algorithm>
+#include "ThreadPool.hpp"
+
+ExhaustiveSearch::ExhaustiveSearch(std::vector<MMGrid> startGrids, double dofWeight, double pathWeight, int numThreads) : simGrids(startGrids), pathWeight(pathWeight), dofWeight(dofWeight), numThreads(numThreads) {}
+
+MMGrid ExhaustiveSearch::simulate()
+{
+    int rows = simGrids[0].getRows(), cols = simGrids[0].getCols();
+    if (rows + cols > 10)
+        std::cout << "Enumerating all designs of a " << rows << "x" << cols << " grid, this is going to take a while" << std::endl;
+    vector<ConstraintGraph> partitions = ConstraintGraph::enumeratePartitions(rows, cols);
+    numDesigns = partitions.size();
+    numBounded = 0;
+    numAborted = 0;
+    std::cout << "Enumerated " << numDesigns << " constraint graph partitions for a " << rows << "x" << cols << " grid" << std::endl;
+
+    // cheapest lower bound first, so good incumbents show up early and the bound prunes most of the tail
+    std::vector<std::pair<int, vector<int>>> designs;
+    for (ConstraintGraph& cg : partitions)
+        designs.push_back(std::make_pair(cg.dofs(), cg.makeCells()));
+    std::stable_sort(designs.begin(), designs.end(), [](const std::pair<int, vector<int>>& a, const std::pair<int, vector<int>>& b) { return a.first < b.first; });
+
+    // designs run concurrently, one thread each
+    CandidateEvaluator evaluator(simGrids, pathWeight, dofWeight, 1);
+    FitnessCache runCache;
+    FitnessCache* fitnessCache = cache ? cache : &runCache;
+    evaluator.setQuasiStatic(quasiStatic);
+    evaluator.setCache(fitnessCache);
+    evaluator.setPersistentCache(store);
+
+    bestErr = DBL_MAX;
+    bestCells = simGrids[0].getCells();
+    calculatedPaths.clear();
+    ThreadPool pool(numThreads);
+    std::vector<std::future<void>> results;
+    for (auto& design : designs)
+    {
+        results.push_back(pool.submit([this, &evaluator, &design]() {
+            double budget;
+            {
+                std::lock_guard<std::mutex> lock(bestMutex);
+                budget = bestErr;
+                if (design.first * dofWeight >= budget)
+                {
+                    numBounded++;
+                    return;
+                }
+            }
+            Evaluation result = evaluator.evaluate(design.second, budget);
+            std::lock_guard<std::mutex> lock(bestMutex);
+            if (result.aborted)
+                numAborted++;
+            else if (result.error < bestErr)
+            {
+                bestErr = result.error;
+                bestCells = design.second;
+                calculatedPaths = result.calculatedPaths;
+                std::cout << "New best weighted error " << bestErr << " with " << design.first << " DOFs" << std::endl;
+            }
+        }));
+    }
+    for (auto& result : results)
+        result.get();
+
+    std::cout << "Searched " << numDesigns << " designs: " << numBounded << " skipped on their DOFs, " << numAborted << " stopped early, "
+        << numDesigns - numBounded - numAborted << " evaluated in full" << std::endl;
+    std::cout << "Prescreen avoided " << evaluator.getPrescreened() << " simulations" << std::endl;
+    fitnessCache->printStats();
+    if (store)
+        store->printStats();
+    std::cout << "Optimal weighted error is " << bestErr << std::endl;
+    simGrids[0].setCells(rows, cols, bestCells);
+    return simGrids[0];
+}
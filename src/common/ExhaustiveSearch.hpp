@@ -0,0 +1,41 @@
+#include <mutex>
+#include "MMGrid.hpp"
+#include "CandidateEvaluator.hpp"
+
+#pragma once
+
+// Evaluates every distinct constraint graph partition of the grid (one minimal cell layout each) and returns the
+// provably best one. Meant for small grids (up to about 4x4, 2100 partitions) and as ground truth for the annealers.
+// Branch and bound: layouts are visited in order of their DOF term, which is a lower bound of their error; once that
+// reaches the best complete error the rest is skipped, and the others are simulated only until they exceed it.
+class ExhaustiveSearch {
+    private:
+        std::vector<MMGrid> simGrids;
+        double pathWeight;
+        double dofWeight;
+        int numThreads;
+        FitnessCache* cache = nullptr;
+        PersistentCache* store = nullptr;
+        bool quasiStatic = false;
+        std::mutex bestMutex;
+        double bestErr;
+        vector<int> bestCells;
+        vector<vector<vector<cpVect>>> calculatedPaths;
+        int numDesigns = 0;
+        int numBounded = 0;
+        int numAborted = 0;
+    public:
+        // numThreads <= 0 uses all hardware cores
+        ExhaustiveSearch(std::vector<MMGrid> startGrids, double dofWeight, double pathWeight, int numThreads = 0);
+        void setCache(FitnessCache* cache) { this->cache = cache; };
+        void setPersistentCache(PersistentCache* store) { this->store = store; };
+        // evaluate with QuasiStaticSolver instead of the Chipmunk simulation
+        void setQuasiStatic(bool quasiStatic) { this->quasiStatic = quasiStatic; };
+        MMGrid simulate();
+        double getBestError() { return bestErr; };
+        vector<vector<vector<cpVect>>> getCalculatedPaths() { return calculatedPaths; };
+        int getNumDesigns() { return numDesigns; };
+        // skipped on the DOF bound alone / simulated only partially
+        int getNumBounded() { return numBounded; };
+        int getNumAborted() { return numAborted; };
+};
@@ -0,0 +1,105 @@
+#include "FeasibilityCheck.hpp"
+#include <cmath>
+#include "ConstraintGraph.hpp"
+
+FeasibilityCheck::FeasibilityCheck(MMGrid& grid) : rows(grid.getRows()), cols(grid.getCols()), anchors(grid.getAnchors()), targets(grid.getTargets()), targetPaths(grid.getTargetPaths())
+{
+    for (int i = 0; i < (rows + 1) * (cols + 1); i++)
+        restPositions.push_back(grid.getRestPosition(i));
+}
+
+double FeasibilityCheck::pathErrorBound(vector<int>& cells, bool& immobile)
+{
+    immobile = false;
+    // without an anchor the whole grid can translate, nothing to bound
+    if (anchors.empty() || targetPaths.empty() || targetPaths[0].empty())
+        return 0;
+    ConstraintGraph cg(rows, cols, cells);
+    vector<int> rowConstraints = cg.getRowConstraints();
+    vector<int> colConstraints = cg.getColConstraints();
+    // component of every row / column: row components are labelled 1..rows, an unconstrained column is its own
+    int numComponents = rows + cols + 1;
+    auto rowComponent = [&](int r) { return rowConstraints[r]; };
+    auto colComponent = [&](int c) { return colConstraints[c] == 0 ? rows + 1 + c : colConstraints[c]; };
+
+    vector<bool> pinned(numComponents);
+    int jointCols = cols + 1;
+    for (int a : anchors)
+    {
+        for (int b : anchors)
+        {
+            // a straight chain between two anchors is fully stretched, every link on it stays at rest
+            if (a / jointCols == b / jointCols)
+                for (int c = std::min(a, b) % jointCols; c < std::max(a, b) % jointCols; c++)
+                    pinned[colComponent(c)] = true;
+            if (a % jointCols == b % jointCols)
+                for (int r = std::min(a, b) / jointCols; r < std::max(a, b) / jointCols; r++)
+                    pinned[rowComponent(r)] = true;
+        }
+    }
+
+    int anchor = anchors[0];
+    int ar = anchor / jointCols, ac = anchor % jointCols;
+    bool anyMobile = false;
+    // per target, the ring around center its joint can reach
+    vector<cpVect> centers;
+    vector<double> rMins, rMaxs;
+    for (int t = 0; t < targets.size(); t++)
+    {
+        int tr = targets[t] / jointCols, tc = targets[t] % jointCols;
+        // rest-state link vectors from the anchor to the target, summed per component
+        vector<cpVect> arms(numComponents, cpvzero);
+        for (int c = std::min(ac, tc); c < std::max(ac, tc); c++)
+            arms[colComponent(c)] = arms[colComponent(c)] + cpv(tc > ac ? 1 : -1, 0);
+        for (int r = std::min(ar, tr); r < std::max(ar, tr); r++)
+            arms[rowComponent(r)] = arms[rowComponent(r)] + cpv(0, tr > ar ? 1 : -1);
+        cpVect center = restPositions[anchor];
+        double rMax = 0, longest = 0;
+        for (int k = 0; k < numComponents; k++)
+        {
+            double length = cpvlength(arms[k]);
+            if (length < 1e-9)
+                continue;
+            if (pinned[k])
+            {
+                center = center + arms[k];
+                continue;
+            }
+            rMax += length;
+            longest = std::max(longest, length);
+        }
+        double rMin = std::max(0.0, 2 * longest - rMax);
+        anyMobile = anyMobile || rMax > 0;
+        centers.push_back(center);
+        rMins.push_back(rMin);
+        rMaxs.push_back(rMax);
+    }
+    immobile = !anyMobile;
+    // least error of all targets against path point p
+    auto pointBound = [&](int p) {
+        double error = 0;
+        for (int t = 0; t < targets.size(); t++)
+        {
+            double d = cpvdist(targetPaths[t][p], centers[t]);
+            double gap = d > rMaxs[t] ? d - rMaxs[t] : d < rMins[t] ? rMins[t] - d : 0;
+            error += gap * gap;
+        }
+        return error;
+    };
+
+    // getPathError adds an error for every pathStep > 0, taken while the joints are pulled towards path point
+    // pathStep - 1; playback may already have moved on to pathStep when it is measured, so either point counts
+    double bound = 0;
+    for (int p = 1; p < targetPaths[0].size(); p++)
+        bound += std::min(pointBound(p - 1), pointBound(p));
+    // and INT8_MAX for pathStep 0
+    return bound + INT8_MAX;
+}
+
+vector<vector<cpVect>> FeasibilityCheck::restPaths()
+{
+    vector<vector<cpVect>> paths;
+    for (int t = 0; t < targets.size(); t++)
+        paths.push_back(vector<cpVect>(targetPaths[t].size(), restPositions[targets[t]]));
+    return paths;
+}
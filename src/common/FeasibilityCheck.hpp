@@ -0,0 +1,26 @@
+#include "MMGrid.hpp"
+
+#pragma once
+
+// Combinatorial lower bound of MMGrid::getPathError, computed from the constraint graph without a cpSpace.
+// Every row of vertical links and every column of horizontal links keeps one direction, a constraint graph
+// component rotates all of its rows and columns together. Seen from an anchor, a target joint therefore moves by
+// a sum of rotating vectors, one per component on the way, and stays inside an annulus around the anchor.
+// Components pinned by two anchors on the same joint row or column stay at rest. The bound sums the squared
+// distances from the target points to those annuli, over the path points getPathError accumulates (each step at the
+// nearer of the two path points it may be measured against).
+class FeasibilityCheck {
+    private:
+        int rows;
+        int cols;
+        vector<int> anchors;
+        vector<int> targets;
+        vector<vector<cpVect>> targetPaths;
+        vector<cpVect> restPositions;
+    public:
+        FeasibilityCheck(MMGrid& grid);
+        // immobile is set if no target joint can move at all, the bound is then the error the layout will have
+        double pathErrorBound(vector<int>& cells, bool& immobile);
+        // the calculated paths of an immobile layout: every target joint stays at rest for every path point
+        vector<vector<cpVect>> restPaths();
+};
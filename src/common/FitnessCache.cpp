@@ -0,0 +1,124 @@
+#include "FitnessCache.hpp"
+#include <cstring>
+
+template <typename T>
+void appendKey(std::string& key, T value)
+{
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    key.append(bytes, sizeof(T));
+}
+
+FitnessCache::FitnessCache() : hits(0), misses(0) {}
+
+std::string FitnessCache::designKey(int rows, int cols, vector<int> cells)
+{
+    std::string key;
+    appendKey(key, rows);
+    appendKey(key, cols);
+    ConstraintGraph cg(rows, cols, cells);
+    for (int c : cg.canonicalConstraints())
+        appendKey(key, c);
+    return key;
+}
+
+std::string FitnessCache::contextKey(std::vector<MMGrid>& pathSets)
+{
+    std::string key;
+    appendKey(key, (int)pathSets.size());
+    for (MMGrid& grid : pathSets)
+    {
+        appendKey(key, grid.getLinkMass());
+        appendKey(key, grid.getBevel());
+        appendKey(key, grid.getStiffness());
+        appendKey(key, grid.getDamping());
+        appendKey(key, grid.getShrinkFactor());
+        vector<int> anchors = grid.getAnchors();
+        appendKey(key, (int)anchors.size());
+        for (int a : anchors)
+            appendKey(key, a);
+        vector<int> targets = grid.getTargets();
+        vector<vector<cpVect>> targetPaths = grid.getTargetPaths();
+        appendKey(key, (int)targets.size());
+        for (int t = 0; t < targets.size(); t++)
+        {
+            appendKey(key, targets[t]);
+            appendKey(key, (int)targetPaths[t].size());
+            for (cpVect p : targetPaths[t])
+            {
+                appendKey(key, p.x);
+                appendKey(key, p.y);
+            }
+        }
+        // both states are tagged: keys from before collisions became optional carry neither tag, so their results
+        // (simulated with collisions) match no current setting
+        key += grid.getCollisions() ? "collisions" : "nocollide";
+        // the parallel stepper and the grid solver solve in color order, which gives (slightly) different results than
+        // cpSpaceStep; they agree with each other up to rounding
+        if (grid.isParallelStepping() || grid.isGridSolving())
+            key += "colored";
+        SimulationProfile profile = grid.getProfile();
+        if (!profile.isDefault())
+        {
+            appendKey(key, profile.iterations);
+            appendKey(key, profile.collisionSlop);
+            appendKey(key, profile.collisionBias);
+            appendKey(key, profile.sleepTimeThreshold);
+            appendKey(key, profile.idleSpeedThreshold);
+            appendKey(key, profile.damping);
+        }
+        // only non-default controllers change the key, so existing caches and checkpoints stay valid
+        ConvergenceSettings convergence = grid.getConvergence();
+        if (!convergence.isDefault())
+        {
+            appendKey(key, convergence.haltDelta);
+            appendKey(key, convergence.energyTolerance);
+            appendKey(key, convergence.calmSteps);
+            appendKey(key, convergence.residualTolerance);
+            appendKey(key, convergence.timeStep);
+            appendKey(key, convergence.maxTimeStep);
+            appendKey(key, convergence.timeStepGrowth);
+            appendKey(key, convergence.maxSteps);
+        }
+    }
+    return key;
+}
+
+bool FitnessCache::lookup(const std::string& key, Evaluation& result)
+{
+    std::lock_guard<std::mutex> lock(entriesMutex);
+    auto it = entries.find(key);
+    if (it == entries.end())
+    {
+        misses++;
+        return false;
+    }
+    hits++;
+    result = it->second;
+    return true;
+}
+
+void FitnessCache::insert(const std::string& key, const Evaluation& result)
+{
+    std::lock_guard<std::mutex> lock(entriesMutex);
+    entries[key] = result;
+}
+
+size_t FitnessCache::size()
+{
+    std::lock_guard<std::mutex> lock(entriesMutex);
+    return entries.size();
+}
+
+void FitnessCache::clear()
+{
+    std::lock_guard<std::mutex> lock(entriesMutex);
+    entries.clear();
+    hits = 0;
+    misses = 0;
+}
+
+void FitnessCache::printStats()
+{
+    std::cout << "Fitness cache: " << hits << " hits, " << misses << " misses (" << hitRate() * 100 << "% hit rate), " << size() << " entries" << std::endl;
+}
@@ -0,0 +1,42 @@
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "MMGrid.hpp"
+
+#pragma once
+
+struct Evaluation {
+    double pathError = 0;
+    int dofs = 0;
+    // pathError * pathWeight + dofs * dofWeight
+    double error = 0;
+    // one slot per path set
+    vector<vector<vector<cpVect>>> calculatedPaths;
+    // stopped early against a budget: error is only a lower bound, never cached
+    bool aborted = false;
+};
+
+// In-memory memo of path errors. Layouts are keyed by their canonical constraint graph partition,
+// so every cell layout that ties the same rows and columns shares one simulation.
+// The context key covers everything else the simulation depends on (anchors, target paths, parameters);
+// the weights are not part of the key, cached entries are re-weighted on lookup.
+class FitnessCache {
+    private:
+        std::unordered_map<std::string, Evaluation> entries;
+        std::mutex entriesMutex;
+        std::atomic<long> hits;
+        std::atomic<long> misses;
+    public:
+        FitnessCache();
+        static std::string designKey(int rows, int cols, vector<int> cells);
+        static std::string contextKey(std::vector<MMGrid>& pathSets);
+        bool lookup(const std::string& key, Evaluation& result);
+        void insert(const std::string& key, const Evaluation& result);
+        long getHits() { return hits; };
+        long getMisses() { return misses; };
+        double hitRate() { return hits + misses == 0 ? 0 : (double)hits / (hits + misses); };
+        size_t size();
+        void clear();
+        void printStats();
+};
@@ -0,0 +1,452 @@
+#include "GridSolver.hpp"
+#include "ParallelStepper.hpp"
+#include "chipmunk/chipmunk_structs.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+
+// a color's constraints share no bodies, so its loops can be vectorized although they write through body indices
+#if defined(__clang__)
+#define INDEPENDENT_ITERATIONS _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define INDEPENDENT_ITERATIONS _Pragma("GCC ivdep")
+#else
+#define INDEPENDENT_ITERATIONS
+#endif
+
+namespace {
+    // Chipmunk doesn't export its default spring torque function, a spring made just for that gives it away
+    cpDampedRotarySpringTorqueFunc defaultSpringTorque()
+    {
+        static cpDampedRotarySpringTorqueFunc torque = []() {
+            cpBody *body = cpBodyNewStatic();
+            cpConstraint *spring = cpDampedRotarySpringNew(body, body, 0, 0, 0);
+            cpDampedRotarySpringTorqueFunc func = cpDampedRotarySpringGetSpringTorqueFunc(spring);
+            cpConstraintFree(spring);
+            cpBodyFree(body);
+            return func;
+        }();
+        return torque;
+    }
+
+    // cpvclamp
+    void clamp(cpFloat &x, cpFloat &y, cpFloat length)
+    {
+        cpFloat lengthSq = x * x + y * y;
+        if (lengthSq > length * length)
+        {
+            cpFloat normalize = 1 / (sqrt(lengthSq) + DBL_MIN);
+            x = x * normalize * length;
+            y = y * normalize * length;
+        }
+    }
+}
+
+void GridSolver::Bodies::resize(int n)
+{
+    handles.resize(n);
+    integrated.resize(n);
+    kinematic.resize(n);
+    for (std::vector<cpFloat> *field : { &px, &py, &angle, &vx, &vy, &w, &mInv, &iInv, &fx, &fy, &torque, &cogX, &cogY, &cosA, &sinA })
+        field->resize(n);
+}
+
+void GridSolver::Pivots::resize(int n)
+{
+    handles.resize(n);
+    a.resize(n);
+    b.resize(n);
+    for (std::vector<cpFloat> *field : { &anchorAx, &anchorAy, &anchorBx, &anchorBy, &maxForce, &errorBias, &maxBias, &r1x, &r1y, &r2x, &r2y,
+        &ka, &kb, &kc, &kd, &biasX, &biasY, &jAccX, &jAccY })
+        field->resize(n);
+}
+
+void GridSolver::Springs::resize(int n)
+{
+    handles.resize(n);
+    a.resize(n);
+    b.resize(n);
+    for (std::vector<cpFloat> *field : { &restAngle, &stiffness, &damping, &iSum, &wCoef, &targetWrn, &jAcc })
+        field->resize(n);
+}
+
+bool GridSolver::layoutCurrent(cpSpace *space)
+{
+    cpArray *spaceBodies = space->dynamicBodies, *constraints = space->constraints;
+    if (layoutBodies.size() != spaceBodies->num || layoutConstraints.size() != constraints->num)
+        return false;
+    for (int i = 0; i < spaceBodies->num; i++)
+        if (layoutBodies[i] != spaceBodies->arr[i])
+            return false;
+    for (int i = 0; i < constraints->num; i++)
+    {
+        cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+        if (layoutConstraints[i] != constraint || layoutConstraintBodies[2 * i] != constraint->a || layoutConstraintBodies[2 * i + 1] != constraint->b)
+            return false;
+    }
+    return true;
+}
+
+// indexes the bodies (the space's first, then static ones only reached through constraints) and sorts the pivots and
+// springs by color
+void GridSolver::layout(cpSpace *space)
+{
+    cpArray *spaceBodies = space->dynamicBodies, *constraints = space->constraints;
+    layoutBodies.assign((cpBody **)spaceBodies->arr, (cpBody **)spaceBodies->arr + spaceBodies->num);
+    layoutConstraints.assign((cpConstraint **)constraints->arr, (cpConstraint **)constraints->arr + constraints->num);
+    layoutConstraintBodies.clear();
+    supported = true;
+
+    std::unordered_map<cpBody *, int> index;
+    std::vector<cpBody *> handles = layoutBodies;
+    for (int i = 0; i < handles.size(); i++)
+        index[handles[i]] = i;
+    std::vector<std::pair<int, int>> constraintBodies;
+    for (cpConstraint *constraint : layoutConstraints)
+    {
+        layoutConstraintBodies.push_back(constraint->a);
+        layoutConstraintBodies.push_back(constraint->b);
+        supported = supported && !constraint->preSolve && !constraint->postSolve && (cpConstraintIsPivotJoint(constraint) ||
+            (cpConstraintIsDampedRotarySpring(constraint) && cpDampedRotarySpringGetSpringTorqueFunc(constraint) == defaultSpringTorque()));
+        for (cpBody *body : { constraint->a, constraint->b })
+            if (index.emplace(body, handles.size()).second)
+                handles.push_back(body);
+        constraintBodies.push_back({ index[constraint->a], index[constraint->b] });
+    }
+    if (!supported)
+        return;
+
+    bodies.resize(handles.size());
+    for (int i = 0; i < handles.size(); i++)
+    {
+        bodies.handles[i] = handles[i];
+        bodies.integrated[i] = i < layoutBodies.size();
+        bodies.kinematic[i] = cpBodyGetType(handles[i]) == CP_BODY_TYPE_KINEMATIC;
+    }
+
+    std::vector<int> colorOf = ParallelStepper::colorConstraints(constraintBodies);
+    int numColors = 0;
+    for (int color : colorOf)
+        numColors = std::max(numColors, color + 1);
+    pivotStart.assign(numColors + 1, 0);
+    springStart.assign(numColors + 1, 0);
+    for (int i = 0; i < colorOf.size(); i++)
+        (cpConstraintIsPivotJoint(layoutConstraints[i]) ? pivotStart : springStart)[colorOf[i] + 1]++;
+    for (int c = 0; c < numColors; c++)
+    {
+        pivotStart[c + 1] += pivotStart[c];
+        springStart[c + 1] += springStart[c];
+    }
+    pivots.resize(pivotStart[numColors]);
+    springs.resize(springStart[numColors]);
+    std::vector<int> nextPivot(pivotStart.begin(), pivotStart.end() - 1), nextSpring(springStart.begin(), springStart.end() - 1);
+    for (int i = 0; i < colorOf.size(); i++)
+    {
+        bool pivot = cpConstraintIsPivotJoint(layoutConstraints[i]);
+        int k = pivot ? nextPivot[colorOf[i]]++ : nextSpring[colorOf[i]]++;
+        (pivot ? pivots.handles : springs.handles)[k] = layoutConstraints[i];
+        (pivot ? pivots.a : springs.a)[k] = constraintBodies[i].first;
+        (pivot ? pivots.b : springs.b)[k] = constraintBodies[i].second;
+    }
+}
+
+bool GridSolver::canStep(cpSpace *space)
+{
+    if (space->sleepTimeThreshold != INFINITY || space->arbiters->num > 0 || cpSpatialIndexCount(space->dynamicShapes) > 0)
+        return false;
+    if (!layoutCurrent(space))
+        layout(space);
+    return supported;
+}
+
+// the bodies' state, the constraints' parameters (the grid changes those in place) and their accumulated impulses
+void GridSolver::gather()
+{
+    for (int i = 0; i < bodies.handles.size(); i++)
+    {
+        cpBody *body = bodies.handles[i];
+        bodies.px[i] = body->p.x;
+        bodies.py[i] = body->p.y;
+        bodies.angle[i] = body->a;
+        bodies.vx[i] = body->v.x;
+        bodies.vy[i] = body->v.y;
+        bodies.w[i] = body->w;
+        bodies.mInv[i] = body->m_inv;
+        bodies.iInv[i] = body->i_inv;
+        bodies.fx[i] = body->f.x;
+        bodies.fy[i] = body->f.y;
+        bodies.torque[i] = body->t;
+        bodies.cogX[i] = body->cog.x;
+        bodies.cogY[i] = body->cog.y;
+        bodies.cosA[i] = body->transform.a;
+        bodies.sinA[i] = body->transform.b;
+    }
+    for (int i = 0; i < pivots.handles.size(); i++)
+    {
+        cpPivotJoint *joint = (cpPivotJoint *)pivots.handles[i];
+        int a = pivots.a[i], b = pivots.b[i];
+        pivots.anchorAx[i] = joint->anchorA.x - bodies.cogX[a];
+        pivots.anchorAy[i] = joint->anchorA.y - bodies.cogY[a];
+        pivots.anchorBx[i] = joint->anchorB.x - bodies.cogX[b];
+        pivots.anchorBy[i] = joint->anchorB.y - bodies.cogY[b];
+        pivots.maxForce[i] = joint->constraint.maxForce;
+        pivots.errorBias[i] = joint->constraint.errorBias;
+        pivots.maxBias[i] = joint->constraint.maxBias;
+        pivots.jAccX[i] = joint->jAcc.x;
+        pivots.jAccY[i] = joint->jAcc.y;
+    }
+    for (int i = 0; i < springs.handles.size(); i++)
+    {
+        cpDampedRotarySpring *spring = (cpDampedRotarySpring *)springs.handles[i];
+        springs.restAngle[i] = spring->restAngle;
+        springs.stiffness[i] = spring->stiffness;
+        springs.damping[i] = spring->damping;
+    }
+}
+
+void GridSolver::scatter()
+{
+    for (int i = 0; i < bodies.handles.size(); i++)
+    {
+        cpBody *body = bodies.handles[i];
+        if (!bodies.integrated[i])
+        {
+            // bodies outside the space (the grid removes free joints but keeps their pivots) still take the
+            // constraints' impulses, as they do in cpSpaceStep; only static ones stay untouched
+            if (bodies.mInv[i] != 0 || bodies.iInv[i] != 0)
+            {
+                body->v = cpv(bodies.vx[i], bodies.vy[i]);
+                body->w = bodies.w[i];
+            }
+            continue;
+        }
+        body->p = cpv(bodies.px[i], bodies.py[i]);
+        body->a = bodies.angle[i];
+        body->v = cpv(bodies.vx[i], bodies.vy[i]);
+        body->w = bodies.w[i];
+        if (!bodies.kinematic[i])
+        {
+            body->f = cpvzero;
+            body->t = 0;
+        }
+        cpFloat c = bodies.cosA[i], s = bodies.sinA[i];
+        body->transform = cpTransformNewTranspose(c, -s, body->p.x - (body->cog.x * c - body->cog.y * s),
+            s, c, body->p.y - (body->cog.x * s + body->cog.y * c));
+    }
+    for (int i = 0; i < pivots.handles.size(); i++)
+    {
+        cpPivotJoint *joint = (cpPivotJoint *)pivots.handles[i];
+        joint->r1 = cpv(pivots.r1x[i], pivots.r1y[i]);
+        joint->r2 = cpv(pivots.r2x[i], pivots.r2y[i]);
+        joint->jAcc = cpv(pivots.jAccX[i], pivots.jAccY[i]);
+        joint->bias = cpv(pivots.biasX[i], pivots.biasY[i]);
+    }
+    for (int i = 0; i < springs.handles.size(); i++)
+    {
+        cpDampedRotarySpring *spring = (cpDampedRotarySpring *)springs.handles[i];
+        spring->iSum = springs.iSum[i];
+        spring->w_coef = springs.wCoef[i];
+        spring->target_wrn = springs.targetWrn[i];
+        spring->jAcc = springs.jAcc[i];
+    }
+}
+
+// cpBodyUpdatePosition (there are no collisions, so no bias velocities)
+void GridSolver::integratePositions(cpFloat dt)
+{
+    for (int i = 0; i < bodies.handles.size(); i++)
+    {
+        if (!bodies.integrated[i])
+            continue;
+        bodies.px[i] += bodies.vx[i] * dt;
+        bodies.py[i] += bodies.vy[i] * dt;
+        bodies.angle[i] += bodies.w[i] * dt;
+        bodies.cosA[i] = cos(bodies.angle[i]);
+        bodies.sinA[i] = sin(bodies.angle[i]);
+    }
+}
+
+// cpBodyUpdateVelocity, which leaves kinematic bodies alone
+void GridSolver::integrateVelocities(cpVect gravity, cpFloat damping, cpFloat dt)
+{
+    for (int i = 0; i < bodies.handles.size(); i++)
+    {
+        if (!bodies.integrated[i] || bodies.kinematic[i])
+            continue;
+        bodies.vx[i] = bodies.vx[i] * damping + (gravity.x + bodies.fx[i] * bodies.mInv[i]) * dt;
+        bodies.vy[i] = bodies.vy[i] * damping + (gravity.y + bodies.fy[i] * bodies.mInv[i]) * dt;
+        bodies.w[i] = bodies.w[i] * damping + bodies.torque[i] * bodies.iInv[i] * dt;
+    }
+}
+
+// cpPivotJoint's preStep: anchors in world space, the inverse of the mass tensor (k_tensor) and the bias velocity
+void GridSolver::preStepPivots(int begin, int end, cpFloat dt)
+{
+    const int *a = pivots.a.data(), *b = pivots.b.data();
+    const cpFloat *px = bodies.px.data(), *py = bodies.py.data(), *cosA = bodies.cosA.data(), *sinA = bodies.sinA.data();
+    const cpFloat *mInv = bodies.mInv.data(), *iInv = bodies.iInv.data();
+    INDEPENDENT_ITERATIONS
+    for (int i = begin; i < end; i++)
+    {
+        int ia = a[i], ib = b[i];
+        cpFloat r1x = cosA[ia] * pivots.anchorAx[i] - sinA[ia] * pivots.anchorAy[i];
+        cpFloat r1y = sinA[ia] * pivots.anchorAx[i] + cosA[ia] * pivots.anchorAy[i];
+        cpFloat r2x = cosA[ib] * pivots.anchorBx[i] - sinA[ib] * pivots.anchorBy[i];
+        cpFloat r2y = sinA[ib] * pivots.anchorBx[i] + cosA[ib] * pivots.anchorBy[i];
+        pivots.r1x[i] = r1x;
+        pivots.r1y[i] = r1y;
+        pivots.r2x[i] = r2x;
+        pivots.r2y[i] = r2y;
+
+        cpFloat mSum = mInv[ia] + mInv[ib];
+        cpFloat k11 = mSum, k12 = 0, k21 = 0, k22 = mSum;
+        cpFloat r1xsq = r1x * r1x * iInv[ia], r1ysq = r1y * r1y * iInv[ia], r1nxy = -r1x * r1y * iInv[ia];
+        k11 += r1ysq;
+        k12 += r1nxy;
+        k21 += r1nxy;
+        k22 += r1xsq;
+        cpFloat r2xsq = r2x * r2x * iInv[ib], r2ysq = r2y * r2y * iInv[ib], r2nxy = -r2x * r2y * iInv[ib];
+        k11 += r2ysq;
+        k12 += r2nxy;
+        k21 += r2nxy;
+        k22 += r2xsq;
+        cpFloat detInv = 1 / (k11 * k22 - k12 * k21);
+        pivots.ka[i] = k22 * detInv;
+        pivots.kb[i] = -k12 * detInv;
+        pivots.kc[i] = -k21 * detInv;
+        pivots.kd[i] = k11 * detInv;
+
+        cpFloat coef = -(1 - pow(pivots.errorBias[i], dt)) / dt;
+        cpFloat biasX = ((px[ib] + r2x) - (px[ia] + r1x)) * coef;
+        cpFloat biasY = ((py[ib] + r2y) - (py[ia] + r1y)) * coef;
+        clamp(biasX, biasY, pivots.maxBias[i]);
+        pivots.biasX[i] = biasX;
+        pivots.biasY[i] = biasY;
+    }
+}
+
+// cpDampedRotarySpring's preStep, which already applies the spring torque
+void GridSolver::preStepSprings(int begin, int end, cpFloat dt)
+{
+    const int *a = springs.a.data(), *b = springs.b.data();
+    const cpFloat *angle = bodies.angle.data(), *iInv = bodies.iInv.data();
+    cpFloat *w = bodies.w.data();
+    INDEPENDENT_ITERATIONS
+    for (int i = begin; i < end; i++)
+    {
+        int ia = a[i], ib = b[i];
+        cpFloat moment = iInv[ia] + iInv[ib];
+        springs.iSum[i] = 1 / moment;
+        springs.wCoef[i] = 1 - exp(-springs.damping[i] * dt * moment);
+        springs.targetWrn[i] = 0;
+        cpFloat jSpring = ((angle[ia] - angle[ib]) - springs.restAngle[i]) * springs.stiffness[i] * dt;
+        springs.jAcc[i] = jSpring;
+        w[ia] -= jSpring * iInv[ia];
+        w[ib] += jSpring * iInv[ib];
+    }
+}
+
+void GridSolver::applyCachedPivotImpulses(int begin, int end, cpFloat dtCoef)
+{
+    const int *a = pivots.a.data(), *b = pivots.b.data();
+    const cpFloat *mInv = bodies.mInv.data(), *iInv = bodies.iInv.data();
+    cpFloat *vx = bodies.vx.data(), *vy = bodies.vy.data(), *w = bodies.w.data();
+    INDEPENDENT_ITERATIONS
+    for (int i = begin; i < end; i++)
+    {
+        int ia = a[i], ib = b[i];
+        cpFloat jx = pivots.jAccX[i] * dtCoef, jy = pivots.jAccY[i] * dtCoef;
+        vx[ia] += -jx * mInv[ia];
+        vy[ia] += -jy * mInv[ia];
+        w[ia] += iInv[ia] * (pivots.r1x[i] * -jy - pivots.r1y[i] * -jx);
+        vx[ib] += jx * mInv[ib];
+        vy[ib] += jy * mInv[ib];
+        w[ib] += iInv[ib] * (pivots.r2x[i] * jy - pivots.r2y[i] * jx);
+    }
+}
+
+// cpPivotJoint's applyImpulse: the impulse that cancels the relative velocity at the anchors (plus the bias),
+// accumulated up to the constraint's maximum force
+void GridSolver::applyPivotImpulses(int begin, int end, cpFloat dt)
+{
+    const int *a = pivots.a.data(), *b = pivots.b.data();
+    const cpFloat *mInv = bodies.mInv.data(), *iInv = bodies.iInv.data();
+    cpFloat *vx = bodies.vx.data(), *vy = bodies.vy.data(), *w = bodies.w.data();
+    INDEPENDENT_ITERATIONS
+    for (int i = begin; i < end; i++)
+    {
+        int ia = a[i], ib = b[i];
+        cpFloat r1x = pivots.r1x[i], r1y = pivots.r1y[i], r2x = pivots.r2x[i], r2y = pivots.r2y[i];
+        cpFloat vrx = (vx[ib] + -r2y * w[ib]) - (vx[ia] + -r1y * w[ia]);
+        cpFloat vry = (vy[ib] + r2x * w[ib]) - (vy[ia] + r1x * w[ia]);
+        cpFloat dx = pivots.biasX[i] - vrx, dy = pivots.biasY[i] - vry;
+        cpFloat jx = dx * pivots.ka[i] + dy * pivots.kb[i];
+        cpFloat jy = dx * pivots.kc[i] + dy * pivots.kd[i];
+        cpFloat oldX = pivots.jAccX[i], oldY = pivots.jAccY[i];
+        cpFloat accX = oldX + jx, accY = oldY + jy;
+        clamp(accX, accY, pivots.maxForce[i] * dt);
+        pivots.jAccX[i] = accX;
+        pivots.jAccY[i] = accY;
+        jx = accX - oldX;
+        jy = accY - oldY;
+        vx[ia] += -jx * mInv[ia];
+        vy[ia] += -jy * mInv[ia];
+        w[ia] += iInv[ia] * (r1x * -jy - r1y * -jx);
+        vx[ib] += jx * mInv[ib];
+        vy[ib] += jy * mInv[ib];
+        w[ib] += iInv[ib] * (r2x * jy - r2y * jx);
+    }
+}
+
+// cpDampedRotarySpring's applyImpulse: damps the relative angular velocity
+void GridSolver::applySpringImpulses(int begin, int end)
+{
+    const int *a = springs.a.data(), *b = springs.b.data();
+    const cpFloat *iInv = bodies.iInv.data();
+    cpFloat *w = bodies.w.data();
+    INDEPENDENT_ITERATIONS
+    for (int i = begin; i < end; i++)
+    {
+        int ia = a[i], ib = b[i];
+        cpFloat wrn = w[ia] - w[ib];
+        cpFloat wDamp = (springs.targetWrn[i] - wrn) * springs.wCoef[i];
+        springs.targetWrn[i] = wrn + wDamp;
+        cpFloat jDamp = wDamp * springs.iSum[i];
+        springs.jAcc[i] += jDamp;
+        w[ia] += jDamp * iInv[ia];
+        w[ib] -= jDamp * iInv[ib];
+    }
+}
+
+bool GridSolver::step(cpSpace *space, cpFloat dt)
+{
+    if (!canStep(space))
+        return false;
+    if (dt == 0)
+        return true;
+    // what cpSpaceStep does besides collision handling and sleeping, neither of which can happen here
+    space->stamp++;
+    cpFloat prevDt = space->curr_dt;
+    space->curr_dt = dt;
+    cpFloat dtCoef = prevDt == 0 ? 0 : dt / prevDt;
+    int numColors = getNumColors();
+    gather();
+    integratePositions(dt);
+    for (int c = 0; c < numColors; c++)
+    {
+        preStepPivots(pivotStart[c], pivotStart[c + 1], dt);
+        preStepSprings(springStart[c], springStart[c + 1], dt);
+    }
+    integrateVelocities(space->gravity, pow(space->damping, dt), dt);
+    for (int c = 0; c < numColors; c++)
+        applyCachedPivotImpulses(pivotStart[c], pivotStart[c + 1], dtCoef);
+    for (int iteration = 0; iteration < space->iterations; iteration++)
+        for (int c = 0; c < numColors; c++)
+        {
+            applyPivotImpulses(pivotStart[c], pivotStart[c + 1], dt);
+            applySpringImpulses(springStart[c], springStart[c + 1]);
+        }
+    scatter();
+    return true;
+}
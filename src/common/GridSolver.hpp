@@ -0,0 +1,71 @@
+#include <vector>
+#include "chipmunk/chipmunk.h"
+
+#pragma once
+
+// Structure-of-arrays cpSpaceStep for the grid's spaces, whose constraints are all pivots and damped rotary springs.
+// A step gathers the bodies' state and the constraints' parameters and accumulated impulses into contiguous arrays,
+// runs Chipmunk's pivot and spring math over them as plain loops and writes the result back, so the cpBodies remain
+// the grid's state between steps. Constraints are solved color by color like in ParallelStepper (same coloring);
+// a color's constraints share no bodies, so each loop is free of dependencies between iterations and vectorizes.
+// Results match a multithreaded ParallelStepper step up to rounding, and differ slightly from cpSpaceStep's.
+class GridSolver {
+    private:
+        struct Bodies {
+            std::vector<cpBody *> handles;
+            // the space's own bodies are integrated (kinematic ones only their positions); the others, bodies of
+            // constraints outside the space, only take impulses
+            std::vector<char> integrated;
+            std::vector<char> kinematic;
+            std::vector<cpFloat> px, py, angle, vx, vy, w, mInv, iInv, fx, fy, torque, cogX, cogY;
+            // rotation of the current angle
+            std::vector<cpFloat> cosA, sinA;
+            void resize(int n);
+        };
+        struct Pivots {
+            std::vector<cpConstraint *> handles;
+            std::vector<int> a, b;
+            // anchors relative to the bodies' centers of gravity
+            std::vector<cpFloat> anchorAx, anchorAy, anchorBx, anchorBy, maxForce, errorBias, maxBias;
+            // set up by preStep: world anchor offsets, inverse mass tensor and bias velocity
+            std::vector<cpFloat> r1x, r1y, r2x, r2y, ka, kb, kc, kd, biasX, biasY;
+            std::vector<cpFloat> jAccX, jAccY;
+            void resize(int n);
+        };
+        struct Springs {
+            std::vector<cpConstraint *> handles;
+            std::vector<int> a, b;
+            std::vector<cpFloat> restAngle, stiffness, damping;
+            std::vector<cpFloat> iSum, wCoef, targetWrn, jAcc;
+            void resize(int n);
+        };
+        Bodies bodies;
+        Pivots pivots;
+        Springs springs;
+        // both are sorted by color, color c's are [pivotStart[c], pivotStart[c + 1]) and [springStart[c], springStart[c + 1])
+        std::vector<int> pivotStart;
+        std::vector<int> springStart;
+        // the space's bodies and constraints when the arrays were laid out, to notice when they change
+        std::vector<cpBody *> layoutBodies;
+        std::vector<cpConstraint *> layoutConstraints;
+        std::vector<cpBody *> layoutConstraintBodies;
+        bool supported = false;
+        bool layoutCurrent(cpSpace *space);
+        void layout(cpSpace *space);
+        void gather();
+        void scatter();
+        void integratePositions(cpFloat dt);
+        void integrateVelocities(cpVect gravity, cpFloat damping, cpFloat dt);
+        void preStepPivots(int begin, int end, cpFloat dt);
+        void preStepSprings(int begin, int end, cpFloat dt);
+        void applyCachedPivotImpulses(int begin, int end, cpFloat dtCoef);
+        void applyPivotImpulses(int begin, int end, cpFloat dt);
+        void applySpringImpulses(int begin, int end);
+    public:
+        // false, without stepping, if the space has collision shapes, lets bodies sleep, has constraint callbacks or
+        // constraints other than pivots and damped rotary springs (those with a custom torque function included)
+        bool canStep(cpSpace *space);
+        // steps the space like cpSpaceStep, or returns false like canStep
+        bool step(cpSpace *space, cpFloat dt);
+        int getNumColors() { return pivotStart.empty() ? 0 : pivotStart.size() - 1; };
+};
@@ -1,16 +1,20 @@
 #define _USE_MATH_DEFINES
 #include "MMGrid.hpp"
-#include "UIModelData.hpp"
+#include "chipmunk/chipmunk_structs.h"
+#include "chipmunk/chipmunk_unsafe.h"
+#include <algorithm>
+#include <cfloat>
+#include <ctime>
+#include <fstream>
 
 const int JOINT_MAX_FORCE = 100;
 
-int MMGrid::counter = 0;
+std::atomic<int> MMGrid::counter(0);
 
 MMGrid::MMGrid(int rows, int cols, vector<int> cells)
 {
     cout << "Constructing MMGrid! "  << counter << endl;
-    mycounter = counter;
-    counter++;
+    mycounter = counter++;
     changingStructure = true;
     this->rows = rows;
     this->cols = cols;
@@ -20,8 +24,7 @@ MMGrid::MMGrid(int rows, int cols, vector<int> cells)
     pointColors = MatrixXd::Zero(vertices.rows(), 3);
     edgeColors = MatrixXd::Zero(edges.rows(), 3);
     setupSimStructures();
-    updateVertices();
-    updateMesh();
+    renderStale = true;
     updateEdges();
     changingStructure = false;
 }
@@ -29,16 +32,23 @@ MMGrid::MMGrid(int rows, int cols, vector<int> cells)
 void MMGrid::setCells(int rows, int cols, vector<int> cells)
 {
     changingStructure = true;
-    removeSimStructures();
-    resetAnimation();
-    this->rows = rows;
-    this->cols = cols;
-    this->cells = cells;
-    vertices = MatrixXd::Zero(jointCols() * jointRows(), 2);
-    edges = MatrixXi::Zero(numColLinks() + numCrossLinks() + numRowLinks() + numActiveLinks(), 2);
-    setupSimStructures();
-    updateVertices();
-    updateMesh();
+    if (rows == this->rows && cols == this->cols && cells.size() == rows * cols && !braces.empty())
+    {
+        resetBodies();
+        setBraces(cells);
+    }
+    else
+    {
+        removeSimStructures();
+        resetAnimation();
+        this->rows = rows;
+        this->cols = cols;
+        this->cells = cells;
+        vertices = MatrixXd::Zero(jointCols() * jointRows(), 2);
+        edges = MatrixXi::Zero(numColLinks() + numCrossLinks() + numRowLinks() + numActiveLinks(), 2);
+        setupSimStructures();
+    }
+    renderStale = true;
     updateEdges();
     changingStructure = false;
 }
@@ -46,11 +56,15 @@ void MMGrid::setCells(int rows, int cols, vector<int> cells)
 void MMGrid::setupSimStructures()
 {
     cout << "Setting up structures for " << mycounter << endl;
-    this->space = cpSpaceNew();
-    setupSpace();
+    if (!space)
+    {
+        space = cpSpaceNew();
+        setupSpace();
+    }
+    springs.clear();
     rowLinks.resize(numRowLinks());
     colLinks.resize(numColLinks());
-    crossLinks.resize(numCrossLinks());
+    restPose.clear();
     joints.clear();
     joints.reserve(jointRows() * jointCols());
     controllers.clear();
@@ -71,9 +85,7 @@ void MMGrid::setupSimStructures()
         int joint_index = (i / cols) * (jointCols()) + (i % cols);
         cpVect posA = bottomLeft + getJointOffset(joint_index) + rowBevOffset;
         cpVect posB = bottomLeft + getJointOffset(joint_index + 1) - rowBevOffset;
-        cpBody *b = makeLinkBody(posA, posB);
-        cpShape *s = makeLinkShape(b, posA, posB);
-        rowLinks[i] = b;
+        rowLinks[i] = makeLinkBody(posA, posB);
     }
     // colLinks
     for (int i = 0; i < numColLinks(); i++)
@@ -81,44 +93,16 @@ void MMGrid::setupSimStructures()
         int joint_index = i;
         cpVect posA = bottomLeft + getJointOffset(joint_index) + colBevOffset;
         cpVect posB = bottomLeft + getJointOffset(joint_index + jointCols()) - colBevOffset;
-        cpBody *b = makeLinkBody(posA, posB);
-        cpShape *s = makeLinkShape(b, posA, posB);
-        colLinks[i] = b;
+        colLinks[i] = makeLinkBody(posA, posB);
     }
+    if (collisions)
+        addLinkShapes();
     // crossLinks
-    int crossLinkIndex = 0;
+    braces.assign(rows * cols, CrossBrace());
     for (int i = 0; i < rows * cols; i++)
         if (cells[i] == 1)
-        {
-            int joint_index = (i / cols) * (jointCols()) + (i % cols);
-            int a_joint_index = (i / cols) * (jointCols() + 1) + (i % cols);
-            cpVect posA1 = bottomLeft + getJointOffset(joint_index), posB1 = bottomLeft + getJointOffset(a_joint_index + 1);
-            cpVect posA2 = bottomLeft + getJointOffset(joint_index + 1), posB2 = bottomLeft + getJointOffset(a_joint_index);
-            cpBody *b1 = makeLinkBody(posA1, posB1), *b2 = makeLinkBody(posA2, posB2);
-            crossLinks[crossLinkIndex] = b1;
-            crossLinkIndex++;
-            crossLinks[crossLinkIndex] = b2;
-            crossLinkIndex++;
-
-            int row_i = i / (cols);
-            int col_i = i % (cols);
-
-            int a_col_prev_idx = (row_i) * (cols + 1) + col_i;
-            int a_col_next_idx = a_col_prev_idx + 1;
-
-            cpBody *row_current = rowLinks[i];
-            cpBody *row_next = rowLinks[i + cols];
-            cpBody *a_prev_col = colLinks[a_col_prev_idx];
-            cpBody *a_next_col = colLinks[a_col_next_idx];
-            cpConstraint *pivot1 = cpPivotJointNew(a_prev_col, b1, bottomLeft + getJointOffset(joint_index));
-            cpConstraint *pivot2 = cpPivotJointNew(a_next_col, b1, bottomLeft + getJointOffset(a_joint_index + 1));
-            cpConstraint *pivot3 = cpPivotJointNew(row_current, b2, bottomLeft + getJointOffset(joint_index + 1));
-            cpConstraint *pivot4 = cpPivotJointNew(row_next, b2, bottomLeft + getJointOffset(a_joint_index));
-            cpSpaceAddConstraint(space, pivot1);
-            cpSpaceAddConstraint(space, pivot2);
-            cpSpaceAddConstraint(space, pivot3);
-            cpSpaceAddConstraint(space, pivot4);
-        }
+            addCrossLinks(i);
+    collectCrossLinks();
     // make pivot constraints
     // first row
     for (int i = 0; i < cols; i++)
@@ -182,7 +166,9 @@ void MMGrid::setupSimStructures()
         cpConstraint *dampedRotarySpring1 = cpDampedRotarySpringNew(prev_col, row_current, 0, stiffness, damping);
         cpConstraint *dampedRotarySpring2 = cpDampedRotarySpringNew(next_col, row_current, 0, stiffness, damping);
         cpSpaceAddConstraint(space, dampedRotarySpring1);
+        springs.push_back(dampedRotarySpring1);
         cpSpaceAddConstraint(space, dampedRotarySpring2);
+        springs.push_back(dampedRotarySpring2);
     }
     // top row
     for (int i = rows * cols; i < (jointRows()) * cols; i++)
@@ -198,7 +184,9 @@ void MMGrid::setupSimStructures()
         cpConstraint *dampedRotarySpring1 = cpDampedRotarySpringNew(prev_col, row_current, 0, stiffness, damping);
         cpConstraint *dampedRotarySpring2 = cpDampedRotarySpringNew(next_col, row_current, 0, stiffness, damping);
         cpSpaceAddConstraint(space, dampedRotarySpring1);
+        springs.push_back(dampedRotarySpring1);
         cpSpaceAddConstraint(space, dampedRotarySpring2);
+        springs.push_back(dampedRotarySpring2);
     }
     // interior rows
     for (int i = cols; i < rows * cols; i++)
@@ -220,9 +208,13 @@ void MMGrid::setupSimStructures()
         cpConstraint *dampedRotarySpring3 = cpDampedRotarySpringNew(b_prev_col, row_current, 0, stiffness, damping);
         cpConstraint *dampedRotarySpring4 = cpDampedRotarySpringNew(b_next_col, row_current, 0, stiffness, damping);
         cpSpaceAddConstraint(space, dampedRotarySpring1);
+        springs.push_back(dampedRotarySpring1);
         cpSpaceAddConstraint(space, dampedRotarySpring2);
+        springs.push_back(dampedRotarySpring2);
         cpSpaceAddConstraint(space, dampedRotarySpring3);
+        springs.push_back(dampedRotarySpring3);
         cpSpaceAddConstraint(space, dampedRotarySpring4);
+        springs.push_back(dampedRotarySpring4);
     }
 
     // make joint bodies + constraints + controller bodies
@@ -341,6 +333,342 @@ void MMGrid::setupSimStructures()
             controllerConstraints.push_back(controlPivot);
         }
     }
+    // the braces' pivots were added first, 4 per braced cell
+    cpArray *constraints = space->constraints;
+    baseConstraints.assign((cpConstraint **)constraints->arr + 4 * crossLinks.size() / 2, (cpConstraint **)constraints->arr + constraints->num);
+}
+
+// segment shapes along the row and column links, where the links are at rest
+void MMGrid::addLinkShapes()
+{
+    cpVect rowBevOffset = cpv(bevel * SQRT_2, 0) * shrink_factor, colBevOffset = cpv(0, bevel * SQRT_2) * shrink_factor;
+    for (int i = 0; i < numRowLinks(); i++)
+    {
+        int joint_index = (i / cols) * (jointCols()) + (i % cols);
+        makeLinkShape(rowLinks[i], bottomLeft + getJointOffset(joint_index) + rowBevOffset, bottomLeft + getJointOffset(joint_index + 1) - rowBevOffset);
+    }
+    for (int i = 0; i < numColLinks(); i++)
+        makeLinkShape(colLinks[i], bottomLeft + getJointOffset(i) + colBevOffset, bottomLeft + getJointOffset(i + jointCols()) - colBevOffset);
+}
+
+void MMGrid::removeLinkShapes()
+{
+    vector<cpShape *> shapes;
+    cpSpaceEachShape(space, [](cpShape *shape, void *data) {
+        ((vector<cpShape *> *)data)->push_back(shape);
+    }, &shapes);
+    for (cpShape *shape : shapes)
+    {
+        cpSpaceRemoveShape(space, shape);
+        cpShapeFree(shape);
+    }
+    // shape ids order the spatial index, without shapes they can start over like in a new space
+    space->shapeIDCounter = 0;
+}
+
+void MMGrid::setStepThreads(int stepThreads)
+{
+    this->stepThreads = std::max(1, stepThreads);
+    stepper.reset(this->stepThreads > 1 ? new ParallelStepper(this->stepThreads) : nullptr);
+}
+
+void MMGrid::setCollisions(bool collisions)
+{
+    if (collisions == this->collisions)
+        return;
+    changingStructure = true;
+    this->collisions = collisions;
+    if (collisions)
+        addLinkShapes();
+    else
+        removeLinkShapes();
+    changingStructure = false;
+}
+
+void MMGrid::addCrossLinks(int i)
+{
+    int joint_index = (i / cols) * (jointCols()) + (i % cols);
+    int a_joint_index = (i / cols) * (jointCols() + 1) + (i % cols);
+    cpVect posA1 = bottomLeft + getJointOffset(joint_index), posB1 = bottomLeft + getJointOffset(a_joint_index + 1);
+    cpVect posA2 = bottomLeft + getJointOffset(joint_index + 1), posB2 = bottomLeft + getJointOffset(a_joint_index);
+    cpBody *b1 = makeLinkBody(posA1, posB1), *b2 = makeLinkBody(posA2, posB2);
+
+    int row_i = i / (cols);
+    int col_i = i % (cols);
+
+    int a_col_prev_idx = (row_i) * (cols + 1) + col_i;
+    int a_col_next_idx = a_col_prev_idx + 1;
+
+    cpBody *row_current = rowLinks[i];
+    cpBody *row_next = rowLinks[i + cols];
+    cpBody *a_prev_col = colLinks[a_col_prev_idx];
+    cpBody *a_next_col = colLinks[a_col_next_idx];
+    CrossBrace &brace = braces[i];
+    brace.links[0] = b1;
+    brace.links[1] = b2;
+    brace.pivots[0] = cpPivotJointNew(a_prev_col, b1, bottomLeft + getJointOffset(joint_index));
+    brace.pivots[1] = cpPivotJointNew(a_next_col, b1, bottomLeft + getJointOffset(a_joint_index + 1));
+    brace.pivots[2] = cpPivotJointNew(row_current, b2, bottomLeft + getJointOffset(joint_index + 1));
+    brace.pivots[3] = cpPivotJointNew(row_next, b2, bottomLeft + getJointOffset(a_joint_index));
+    for (cpConstraint *pivot : brace.pivots)
+        cpSpaceAddConstraint(space, pivot);
+}
+
+void MMGrid::removeCrossLinks(int i)
+{
+    CrossBrace &brace = braces[i];
+    for (cpConstraint *pivot : brace.pivots)
+    {
+        cpSpaceRemoveConstraint(space, pivot);
+        cpConstraintFree(pivot);
+    }
+    for (cpBody *link : brace.links)
+    {
+        cpSpaceRemoveBody(space, link);
+        restPose.erase(link);
+        cpBodyFree(link);
+    }
+    brace = CrossBrace();
+}
+
+// crossLinks in cell order, as the rest of the grid expects them
+void MMGrid::collectCrossLinks()
+{
+    crossLinks.clear();
+    for (CrossBrace &brace : braces)
+        if (brace.links[0])
+        {
+            crossLinks.push_back(brace.links[0]);
+            crossLinks.push_back(brace.links[1]);
+        }
+}
+
+void MMGrid::resetToRest()
+{
+    resetBodies();
+    calculatedPaths.clear();
+}
+
+void MMGrid::resetBodies()
+{
+    vector<int> held = constrainedJoints;
+    for (int jointIndex : held)
+        removeJointController(jointIndex);
+    for (auto &rest : restPose)
+    {
+        cpBody *body = rest.first;
+        // getPathError takes free joints and their controllers out of the space
+        if (!cpSpaceContainsBody(space, body))
+            cpSpaceAddBody(space, body);
+        cpBodySetPosition(body, rest.second);
+        cpBodySetAngle(body, 0);
+        cpBodySetVelocity(body, cpvzero);
+        cpBodySetAngularVelocity(body, 0);
+        cpBodySetForce(body, cpvzero);
+        cpBodySetTorque(body, 0);
+        body->v_bias = cpvzero;
+        body->w_bias = 0;
+    }
+    // drops the contacts along with the shapes, the new shapes are indexed as in a fresh build
+    if (collisions)
+    {
+        removeLinkShapes();
+        addLinkShapes();
+    }
+    resetSolverState();
+    resetAnimation();
+}
+
+// puts the solver where a fresh build of the current layout starts, so a reused grid simulates a layout exactly like
+// a new one: the constraints in build order (removing one moves the space's last constraint into its slot), no
+// accumulated impulses and no previous time step to scale them by
+void MMGrid::resetSolverState()
+{
+    cpArray *constraints = space->constraints;
+    int numBraced = crossLinks.size() / 2;
+    // held joints' controller pivots would be in the space too, resetBodies releases them first
+    if (constraints->num == 4 * numBraced + baseConstraints.size())
+    {
+        int n = 0;
+        for (CrossBrace &brace : braces)
+            if (brace.links[0])
+                for (cpConstraint *pivot : brace.pivots)
+                    constraints->arr[n++] = pivot;
+        for (cpConstraint *constraint : baseConstraints)
+            constraints->arr[n++] = constraint;
+    }
+    // controller pivots keep theirs while out of the space
+    vector<cpConstraint *> all((cpConstraint **)constraints->arr, (cpConstraint **)constraints->arr + constraints->num);
+    all.insert(all.end(), controllerConstraints.begin(), controllerConstraints.end());
+    for (cpConstraint *constraint : all)
+    {
+        if (cpConstraintIsPivotJoint(constraint))
+            ((cpPivotJoint *)constraint)->jAcc = cpvzero;
+        else if (cpConstraintIsDampedRotarySpring(constraint))
+            ((cpDampedRotarySpring *)constraint)->jAcc = 0;
+    }
+    space->curr_dt = 0;
+}
+
+MMGridState MMGrid::snapshot()
+{
+    MMGridState state;
+    state.bodies.reserve(7 * restPose.size());
+    for (vector<cpBody *> *group : {&rowLinks, &colLinks, &crossLinks, &joints, &controllers})
+        for (cpBody *body : *group)
+        {
+            cpVect p = cpBodyGetPosition(body), v = cpBodyGetVelocity(body);
+            state.bodies.insert(state.bodies.end(), {p.x, p.y, cpBodyGetAngle(body), v.x, v.y, cpBodyGetAngularVelocity(body), cpSpaceContainsBody(space, body) ? 1.0 : 0.0});
+        }
+    state.cells = cells;
+    state.constrainedJoints = constrainedJoints;
+    state.pointIndex = pointIndex;
+    state.frameTime = frameTime;
+    state.generation = generation;
+    return state;
+}
+
+bool MMGrid::restore(const MMGridState &state)
+{
+    if (state.cells != cells || state.generation != generation || state.bodies.size() != 7 * restPose.size())
+        return false;
+    changingStructure = true;
+    vector<int> held = constrainedJoints;
+    for (int jointIndex : held)
+        if (find(state.constrainedJoints.begin(), state.constrainedJoints.end(), jointIndex) == state.constrainedJoints.end())
+            removeJointController(jointIndex);
+    // held before the bodies are restored, so the controllers end up where the snapshot had them
+    for (int jointIndex : state.constrainedJoints)
+        addJointController(jointIndex);
+    const cpFloat *b = state.bodies.data();
+    for (vector<cpBody *> *group : {&rowLinks, &colLinks, &crossLinks, &joints, &controllers})
+        for (cpBody *body : *group)
+        {
+            bool inSpace = cpSpaceContainsBody(space, body);
+            if (b[6] != 0 && !inSpace)
+                cpSpaceAddBody(space, body);
+            else if (b[6] == 0 && inSpace)
+                cpSpaceRemoveBody(space, body);
+            cpBodySetPosition(body, cpv(b[0], b[1]));
+            cpBodySetAngle(body, b[2]);
+            cpBodySetVelocity(body, cpv(b[3], b[4]));
+            cpBodySetAngularVelocity(body, b[5]);
+            b += 7;
+        }
+    pointIndex = state.pointIndex;
+    frameTime = state.frameTime;
+    renderStale = true;
+    changingStructure = false;
+    return true;
+}
+
+void MMGrid::setCellRigid(int cellIndex, bool rigid)
+{
+    bool braced = braces[cellIndex].links[0] != nullptr;
+    if (rigid && !braced)
+        addCrossLinks(cellIndex);
+    else if (!rigid && braced)
+        removeCrossLinks(cellIndex);
+    else
+        return;
+    cells[cellIndex] = rigid ? 1 : 0;
+    collectCrossLinks();
+    resetSolverState();
+    edges = MatrixXi::Zero(numColLinks() + numCrossLinks() + numRowLinks() + numActiveLinks(), 2);
+    updateEdges();
+}
+
+void MMGrid::applyCells(vector<int> cells)
+{
+    if (cells.size() != rows * cols)
+    {
+        setCells(rows, cols, cells);
+        return;
+    }
+    changingStructure = true;
+    resetToRest();
+    setBraces(cells);
+    renderStale = true;
+    updateEdges();
+    changingStructure = false;
+}
+
+// adds or removes cross-links where cells differ from the current layout, the grid should be at rest
+void MMGrid::setBraces(vector<int> cells)
+{
+    for (int i = 0; i < rows * cols; i++)
+    {
+        bool braced = braces[i].links[0] != nullptr;
+        if (cells[i] == 1 && !braced)
+            addCrossLinks(i);
+        else if (cells[i] != 1 && braced)
+            removeCrossLinks(i);
+    }
+    this->cells = cells;
+    collectCrossLinks();
+    resetSolverState();
+    edges = MatrixXi::Zero(numColLinks() + numCrossLinks() + numRowLinks() + numActiveLinks(), 2);
+}
+
+void MMGrid::updateParameters()
+{
+    changingStructure = true;
+    generation++;
+    resetBodies();
+    cpVect rowBevOffset = cpv(bevel * SQRT_2, 0) * shrink_factor, colBevOffset = cpv(0, bevel * SQRT_2) * shrink_factor;
+    for (int i = 0; i < numRowLinks(); i++)
+    {
+        int joint_index = (i / cols) * (jointCols()) + (i % cols);
+        reshapeLink(rowLinks[i], bottomLeft + getJointOffset(joint_index) + rowBevOffset, bottomLeft + getJointOffset(joint_index + 1) - rowBevOffset);
+    }
+    for (int i = 0; i < numColLinks(); i++)
+        reshapeLink(colLinks[i], bottomLeft + getJointOffset(i) + colBevOffset, bottomLeft + getJointOffset(i + jointCols()) - colBevOffset);
+    for (int i = 0; i < rows * cols; i++)
+    {
+        if (!braces[i].links[0])
+            continue;
+        int joint_index = (i / cols) * (jointCols()) + (i % cols);
+        int a_joint_index = (i / cols) * (jointCols() + 1) + (i % cols);
+        reshapeLink(braces[i].links[0], bottomLeft + getJointOffset(joint_index), bottomLeft + getJointOffset(a_joint_index + 1));
+        reshapeLink(braces[i].links[1], bottomLeft + getJointOffset(joint_index + 1), bottomLeft + getJointOffset(a_joint_index));
+    }
+    for (cpBody *joint : joints)
+        cpBodySetMass(joint, linkMass / 10);
+    for (cpConstraint *spring : springs)
+    {
+        cpDampedRotarySpringSetStiffness(spring, stiffness);
+        cpDampedRotarySpringSetDamping(spring, damping);
+    }
+    renderStale = true;
+    updateEdges();
+    changingStructure = false;
+}
+
+// moves a link at rest to span posA-posB (the bevel shifts where links start) and updates its mass, moment and shape
+void MMGrid::reshapeLink(cpBody *body, cpVect posA, cpVect posB)
+{
+    // pivots stay at the joints, so their anchors on this link move against the link
+    cpVect shift = posA - restPose[body];
+    cpBodyEachConstraint(body, [](cpBody *body, cpConstraint *constraint, void *data) {
+        cpVect shift = *(cpVect *)data;
+        if (!cpConstraintIsPivotJoint(constraint))
+            return;
+        if (cpConstraintGetBodyA(constraint) == body)
+            cpPivotJointSetAnchorA(constraint, cpPivotJointGetAnchorA(constraint) - shift);
+        else
+            cpPivotJointSetAnchorB(constraint, cpPivotJointGetAnchorB(constraint) - shift);
+    }, &shift);
+    restPose[body] = posA;
+    cpBodySetPosition(body, posA);
+    cpBodySetMass(body, linkMass);
+    cpBodySetMoment(body, cpMomentForSegment(linkMass, cpvzero, posB - posA, bevel));
+    std::pair<cpVect, cpFloat> segment(posB - posA, bevel);
+    cpBodyEachShape(body, [](cpBody *body, cpShape *shape, void *data) {
+        auto segment = (std::pair<cpVect, cpFloat> *)data;
+        cpSegmentShapeSetEndpoints(shape, cpvzero, segment->first);
+        cpSegmentShapeSetRadius(shape, segment->second);
+    }, &segment);
+    cpSpaceReindexShapesForBody(space, body);
 }
 
 bool MMGrid::isConstrained(int jointIndex)
@@ -357,18 +685,7 @@ void MMGrid::updateVertices()
     for (int i = 0; i < jointRows() * jointCols(); i++)
     {
         cpVect pos = cpBodyGetPosition(joints[i]);
-        if (isConstrained(i))
-        {
-            cpVect posC = cpBodyGetPosition(controllers[i]);
-            //vertices.row(i) = (Vector2d() << posC.x, posC.y).finished();
-            vertices.row(i) = (Vector2d() << pos.x, pos.y).finished();
-        }
-        else
-        {
-            vertices.row(i) = (Vector2d() << pos.x, pos.y).finished();
-            cpBody *controller = controllers[i];
-            cpBodySetPosition(controller, pos);
-        }
+        vertices.row(i) = (Vector2d() << pos.x, pos.y).finished();
     }
 
     // for (int i = 0; i < numRowLinks(); i++)
@@ -391,42 +708,35 @@ void MMGrid::updateVertices()
 
 void MMGrid::updateMesh()
 {
-
     cpVect rowBevOffset = cpv(bevel * SQRT_2, 0);
     rowBevOffset = rowBevOffset * shrink_factor;
+    double length = 1 - 2 * (double)rowBevOffset.x;
+    int numLinks = numRowLinks() + numColLinks();
+    if (!capsule.matches(bevel, length, resolution))
+    {
+        capsule = makeCapsuleTemplate(bevel, length, resolution);
+        mesh.second.resize(0, 3);
+    }
+    // faces and the vertex buffer only change with the grid size or the capsule
+    if (mesh.second.rows() != numLinks * capsule.F.rows())
+    {
+        mesh.second = instanceFaces(capsule, numLinks);
+        mesh.first.resize(numLinks * capsule.V.rows(), 3);
+    }
 
-    std::vector<std::pair<MatrixX3d, MatrixX3i>> meshes;
-
-    //ground:
-    /*MatrixX3d groundV = MatrixX3d::Zero(4, 3);
-    groundV << -10, 0, -10,
-        -10, 0, 10,
-        10, 0, -10,
-        10, 0, 10;
-    MatrixX3i groundF = MatrixX3i::Zero(2, 3);
-    groundF << 0, 1, 2,
-        2, 1, 3;
-    meshes.push_back(std::make_pair(groundV, groundF));*/
-
+    // row links lie along x, the capsule along y
+    MatrixX3d poses(numLinks, 3);
     for (int i = 0; i < numRowLinks(); i++)
     {
         cpVect pos = cpBodyGetPosition(rowLinks[i]);
-        cpVect rot = cpBodyGetRotation(rowLinks[i]);
-        double rotation = cpvtoangle(rot);
-        Vector3d base((double)pos.x, (double)pos.y, 0);
-        std::pair<MatrixX3d, MatrixX3i> link = generateCapsule(base, bevel, 1 - 2 * (double)rowBevOffset.x, resolution, rotation - M_PI_2);
-        meshes.push_back(link);
+        poses.row(i) << pos.x, pos.y, cpvtoangle(cpBodyGetRotation(rowLinks[i])) - M_PI_2;
     }
     for (int i = 0; i < numColLinks(); i++)
     {
         cpVect pos = cpBodyGetPosition(colLinks[i]);
-        cpVect rot = cpBodyGetRotation(colLinks[i]);
-        double rotation = cpvtoangle(rot);
-        Vector3d base((double)pos.x, (double)pos.y, 0);
-        std::pair<MatrixX3d, MatrixX3i> link = generateCapsule(base, bevel, 1 - 2 * (double)rowBevOffset.x, resolution, rotation);
-        meshes.push_back(link);
+        poses.row(numRowLinks() + i) << pos.x, pos.y, cpvtoangle(cpBodyGetRotation(colLinks[i]));
     }
-    mesh = combineMeshes(meshes);
+    placeCapsules(capsule, poses, mesh.first);
 }
 
 void MMGrid::updateMeshUnified()
@@ -497,119 +807,6 @@ void MMGrid::updateEdges()
     }
 }
 
-void MMGrid::render(igl::opengl::glfw::Viewer *viewer, int selected_cell, int selected_joint)
-{
-    while (changingStructure)
-    {
-        cout << "Waiting for finish changing structure..." << endl;
-    }
-    pointColors = MatrixXd::Zero(vertices.rows(), 3);
-    edgeColors = MatrixXd::Zero(edges.rows(), 3);
-
-    pointColors.row(selected_joint) += (Vector3d() << 1, 0, 0).finished();
-    for (int index : constrainedJoints)
-    {
-        pointColors.row(index) += (Vector3d() << 0, 0, 1).finished();
-    }
-
-    int edge_index = 0;
-
-    bool u_selection_done = false;
-    bool r_selection_done = false;
-    // update edge colors
-    for (int i = 0; i < rows * cols; i++)
-    {
-        if (i == selected_cell)
-            edgeColors.row(edge_index) += (Vector3d() << 1, 0, 0).finished();
-        else if (!u_selection_done && i == (selected_cell + cols))
-        {
-            edgeColors.row(edge_index) += (Vector3d() << 1, 0, 0).finished();
-            u_selection_done = true;
-        }
-        edge_index++;
-        if (i == selected_cell)
-            edgeColors.row(edge_index) += (Vector3d() << 1, 0, 0).finished();
-        else if (!r_selection_done && i == (selected_cell + 1))
-        {
-            edgeColors.row(edge_index) += (Vector3d() << 1, 0, 0).finished();
-            r_selection_done = true;
-        }
-        edge_index++;
-        if ((i + 1) % cols == 0)
-        {
-            if (i == selected_cell)
-            {
-                edgeColors.row(edge_index) += (Vector3d() << 1, 0, 0).finished();
-                r_selection_done = true;
-            }
-            edge_index++;
-        }
-        if (i >= (cols * (rows - 1)))
-        {
-            if (i == selected_cell)
-            {
-                edgeColors.row(edge_index) += (Vector3d() << 1, 0, 0).finished();
-                u_selection_done = true;
-            }
-            edge_index++;
-        }
-        if (cells[i] == 1)
-        {
-            edgeColors.row(edge_index) += (Vector3d() << 0, 0, 1).finished();
-            edge_index++;
-            edgeColors.row(edge_index) += (Vector3d() << 0, 0, 1).finished();
-            edge_index++;
-        }
-    }
-
-    MatrixX3d points = MatrixXd::Zero(vertices.rows(), 3);
-    points << vertices, MatrixXd::Zero(vertices.rows(), 1);
-
-    MatrixX3d edgePoints = MatrixXd::Zero(vertices.rows(), 3);
-    MatrixX3d edgeColors2 = MatrixXd::Zero(edgeColors.rows(), 3);
-    MatrixX2i edges2 = MatrixXi::Zero(edges.rows(), 2);
-    if (targetVerts.rows() == 0)
-    {
-        edgePoints << points;
-        edges2 << edges;
-        edgeColors2 << edgeColors;
-    }
-    else
-    {
-        if (calcVerts.rows() == 0) {
-            //cout << "No calc" << endl;
-            MatrixX2d intermediate = MatrixXd::Zero(vertices.rows() + targetVerts.rows(), 2);
-            intermediate << vertices, targetVerts;
-            edgePoints = MatrixXd::Zero(intermediate.rows(), 3);
-            edgePoints << intermediate, MatrixXd::Zero(intermediate.rows(), 1);
-            edges2 = MatrixXi::Zero(edges.rows() + targetEdges.rows(), 2);
-            edges2 << edges, targetEdges + MatrixXi::Constant(targetEdges.rows(), 2, vertices.rows());
-            edgeColors2 = MatrixXd::Zero(edges.rows() + targetEdges.rows(), 3);
-            edgeColors2 << edgeColors, MatrixXd::Zero(targetEdges.rows(), 3);
-        }
-        else {
-            //cout << "No calc" << endl;
-            MatrixX2d intermediate = MatrixXd::Zero(vertices.rows() + targetVerts.rows() + calcVerts.rows(), 2);
-            intermediate << vertices, targetVerts, calcVerts;
-            edgePoints = MatrixXd::Zero(intermediate.rows(), 3);
-            edgePoints << intermediate, MatrixXd::Zero(intermediate.rows(), 1);
-            edges2 = MatrixXi::Zero(edges.rows() + targetEdges.rows() + calcEdges.rows(), 2);
-            edges2 << edges, targetEdges + MatrixXi::Constant(targetEdges.rows(), 2, vertices.rows()), calcEdges + MatrixXi::Constant(calcEdges.rows(), 2, vertices.rows() + targetVerts.rows());
-            edgeColors2 = MatrixXd::Zero(edges.rows() + targetEdges.rows() + calcEdges.rows(), 3);
-            edgeColors2 << edgeColors, MatrixXd::Zero(targetEdges.rows() + calcEdges.rows(), 3);
-        }
-    }
-    MatrixX3d faceColors(mesh.second.rows(), 3);
-    for (int i = 0; i < faceColors.rows(); i++) {
-        faceColors.row(i) = Vector3d(.231, .231, .231);
-    }
-    viewer->data().clear();
-    viewer->data().set_points(points, pointColors);
-    viewer->data().set_edges(edgePoints, edges2, edgeColors2);
-    viewer->data().set_mesh(mesh.first, mesh.second);
-    viewer->data().set_colors(faceColors);
-}
-
 void MMGrid::resetAnimation() {
     pointIndex = 0;
     frameTime = 0;
@@ -638,10 +835,8 @@ vector<vector<double>> MMGrid::getAnglesFor(vector<int> cellIndices)
         out.push_back({});
     }
     int pathStepsPerSec = 3;
-    double timeStep = 0.5 / 60;
-    double totError = 0;
-    double haltDelta = 1e-4;
-    update_follow_path(timeStep, pathStepsPerSec);
+    update_follow_path(convergence.timeStep, pathStepsPerSec);
+    pointConvergence.clear();
     for(int i = 0; i < (rows + 1) * (cols + 1); i++) {
         if(!isConstrained(i)) {
             cpSpaceRemoveBody(space, joints[i]);
@@ -652,18 +847,7 @@ vector<vector<double>> MMGrid::getAnglesFor(vector<int> cellIndices)
     }
     for (int pathStep = 0; pathStep < targetPaths[0].size(); pathStep++)
     {
-        int numIterations = 0;
-        double curError, prevError = INT8_MAX;
-        while(pointIndex < pathStep) {
-            update_follow_path(timeStep, pathStepsPerSec);
-            numIterations++;
-            curError = getCurrentError();
-            if(abs(prevError - curError) < haltDelta) {
-                pointIndex++;
-                frameTime = 0;
-            }
-            prevError = curError;
-        }
+        settlePoint(pathStep, pathStepsPerSec);
         for(int i = 0; i < cellIndices.size(); i++) {
             double angleDiff = cpvtoangle(cpBodyGetRotation(colLinks[colLinkIndices[i]])) + M_PI_2 - cpvtoangle(cpBodyGetRotation(rowLinks[rowLinkIndices[i]]));
             out[i].push_back(angleDiff);
@@ -871,33 +1055,53 @@ void MMGrid::unanchor(int jointIndex)
 void MMGrid::update(cpFloat dt)
 {
     changingStructure = true;
-    cpSpaceStep(space, dt);
-    updateVertices();
-    updateMesh();
+    bool stepped = (gridSolver && gridSolver->step(space, dt)) || (stepper && stepper->step(space, dt));
+    if (!stepped)
+        cpSpaceStep(space, dt);
+    renderStale = true;
     changingStructure = false;
 }
 MMGrid::~MMGrid()
 {
     cout << "Destroying / freeing " << mycounter << endl;
     removeSimStructures();
+    cpSpaceFree(space);
 }
 void MMGrid::removeSimStructures()
 {
     cout << "Removing structures for " << mycounter << endl;
-    /*cpSpaceEachConstraint(space, [](cpConstraint * constraint, void* data) {
+    // empties the space but keeps it, setupSimStructures refills it
+    vector<cpConstraint *> constraints;
+    cpSpaceEachConstraint(space, [](cpConstraint *constraint, void *data) {
+        ((vector<cpConstraint *> *)data)->push_back(constraint);
+    }, &constraints);
+    removeLinkShapes();
+    for (cpConstraint *constraint : constraints)
+        cpSpaceRemoveConstraint(space, constraint);
+    // controller pivots are only in the space while their joint is held
+    for (int i = 0; i < controllerConstraints.size(); i++)
+        if (!isConstrained(i))
+            constraints.push_back(controllerConstraints[i]);
+    for (cpConstraint *constraint : constraints)
         cpConstraintFree(constraint);
-    }, nullptr);
-    cpSpaceEachShape(space, [](cpShape* shape, void* data) {
-        cpShapeFree(shape);
-        }, nullptr);
-    cpSpaceEachBody(space, [](cpBody* body, void* data) {
-        cpBodyFree(body);
-        }, nullptr);*/
-    cout << "All Freed, freeing space..." << endl;
-    cpSpaceFree(space);
+    // getPathError takes some bodies out of the space, restPose has all of them
+    for (auto &rest : restPose)
+    {
+        if (cpSpaceContainsBody(space, rest.first))
+            cpSpaceRemoveBody(space, rest.first);
+        cpBodyFree(rest.first);
+    }
+    cout << "All Freed" << endl;
     rowLinks.clear();
     colLinks.clear();
     crossLinks.clear();
+    braces.clear();
+    springs.clear();
+    restPose.clear();
+    joints.clear();
+    controllers.clear();
+    constrainedJoints.clear();
+    controllerConstraints.clear();
 }
 
 void MMGrid::applyForce(int direction, int selected_cell)
@@ -941,6 +1145,8 @@ void MMGrid::addJointController(int jointIndex)
 {
     if (isConstrained(jointIndex))
         return;
+    // a free joint's controller doesn't follow it, it picks the joint up where it is now
+    cpBodySetPosition(controllers[jointIndex], cpBodyGetPosition(joints[jointIndex]));
     constrainedJoints.push_back(jointIndex);
     cpSpaceAddConstraint(space, controllerConstraints[jointIndex]);
 }
@@ -1032,7 +1238,7 @@ void MMGrid::updateCalculatedRenderPaths()
 
 cpVect MMGrid::getPos(int jointIndex)
 {
-    return cpBodyGetPosition(controllers[jointIndex]);
+    return cpBodyGetPosition(isConstrained(jointIndex) ? controllers[jointIndex] : joints[jointIndex]);
 }
 
 void MMGrid::setJointMaxForce(int jointIndex, cpFloat force)
@@ -1197,7 +1403,6 @@ void MMGrid::loadFromFile(const std::string fname)
         }
 
         targetPaths.push_back(path);
-        UIModelData::paths.insert(std::make_pair(fname + "(" + std::to_string(c) + ")", path));
         path.clear();
     }
 
@@ -1324,6 +1529,74 @@ void MMGrid::setPath(vector<cpVect> path, int target)
     updateTargetRenderPaths();
 }
 
+void MMGrid::setTargetPaths(vector<int> targets, vector<vector<cpVect>> targetPaths)
+{
+    this->targets = targets;
+    this->targetPaths = targetPaths;
+    updateTargetRenderPaths();
+}
+
+vector<cpFloat> MMGrid::linkPose()
+{
+    vector<cpFloat> pose;
+    pose.reserve(3 * (rowLinks.size() + colLinks.size()));
+    for (vector<cpBody *> *group : {&rowLinks, &colLinks})
+        for (cpBody *link : *group)
+        {
+            cpVect p = cpBodyGetPosition(link);
+            pose.insert(pose.end(), {p.x, p.y, cpBodyGetAngle(link)});
+        }
+    return pose;
+}
+
+void MMGrid::applyLinkPose(const vector<cpFloat> &pose)
+{
+    if (pose.size() != 3 * (rowLinks.size() + colLinks.size()))
+        return;
+    const cpFloat *p = pose.data();
+    for (vector<cpBody *> *group : {&rowLinks, &colLinks})
+        for (cpBody *link : *group)
+        {
+            cpBodySetPosition(link, cpv(p[0], p[1]));
+            cpBodySetAngle(link, p[2]);
+            cpBodySetVelocity(link, cpvzero);
+            cpBodySetAngularVelocity(link, 0);
+            p += 3;
+        }
+    // every joint is an end of a column link
+    vector<cpVect> jointPos(jointRows() * jointCols());
+    for (int i = 0; i < numColLinks(); i++)
+    {
+        jointPos[i] = linkPoint(colLinks[i], i);
+        jointPos[i + jointCols()] = linkPoint(colLinks[i], i + jointCols());
+    }
+    for (int i = 0; i < joints.size(); i++)
+    {
+        cpBodySetPosition(joints[i], jointPos[i]);
+        cpBodySetVelocity(joints[i], cpvzero);
+    }
+    // the cross-links are what differs between layouts, they take the rotation their diagonal went through
+    for (int i = 0; i < rows * cols; i++)
+    {
+        if (!braces[i].links[0])
+            continue;
+        int joint_index = (i / cols) * (jointCols()) + (i % cols);
+        int a_joint_index = (i / cols) * (jointCols() + 1) + (i % cols);
+        int ends[2][2] = {{joint_index, a_joint_index + 1}, {joint_index + 1, a_joint_index}};
+        for (int l = 0; l < 2; l++)
+        {
+            cpBody *link = braces[i].links[l];
+            cpVect restA = getRestPosition(ends[l][0]), restB = getRestPosition(ends[l][1]);
+            cpVect a = jointPos[ends[l][0]], b = jointPos[ends[l][1]];
+            cpFloat angle = cpvtoangle(b - a) - cpvtoangle(restB - restA);
+            cpBodySetAngle(link, angle);
+            cpBodySetPosition(link, a + cpvrotate(restPose[link] - restA, cpvforangle(angle)));
+            cpBodySetVelocity(link, cpvzero);
+            cpBodySetAngularVelocity(link, 0);
+        }
+    }
+}
+
 void MMGrid::recordPoints() {
     for (int i = 0; i < targetPaths.size(); i++)
     {
@@ -1335,14 +1608,63 @@ void MMGrid::recordPoints() {
     }
 }
 
-double MMGrid::getPathError()
+bool ConvergenceSettings::isDefault() const
+{
+    ConvergenceSettings defaults;
+    return haltDelta == defaults.haltDelta && energyTolerance == defaults.energyTolerance && calmSteps == defaults.calmSteps &&
+        residualTolerance == defaults.residualTolerance && timeStep == defaults.timeStep && maxTimeStep == defaults.maxTimeStep &&
+        timeStepGrowth == defaults.timeStepGrowth && maxSteps == defaults.maxSteps;
+}
+
+cpFloat MMGrid::linkKineticEnergy()
+{
+    cpFloat energy = 0;
+    for (auto links : {&rowLinks, &colLinks, &crossLinks})
+        for (cpBody *link : *links)
+            energy += cpBodyKineticEnergy(link);
+    return energy;
+}
+
+// steps the simulation until the grid settles at path point pathStep (see ConvergenceSettings), returns the target error
+double MMGrid::settlePoint(int pathStep, int pathStepsPerSec)
+{
+    PointConvergence point;
+    cpFloat dt = convergence.timeStep;
+    double curError = INT8_MAX, prevError = INT8_MAX;
+    int calm = 0;
+    while(pointIndex < pathStep) {
+        update_follow_path(dt, pathStepsPerSec);
+        point.steps++;
+        curError = getCurrentError();
+        bool calmStep = abs(prevError - curError) < convergence.haltDelta;
+        if (convergence.energyTolerance > 0) {
+            point.kineticEnergy = linkKineticEnergy();
+            calmStep = calmStep && point.kineticEnergy < convergence.energyTolerance;
+        }
+        calm = calmStep ? calm + 1 : 0;
+        point.settled = calm >= convergence.calmSteps || (convergence.residualTolerance > 0 && curError < convergence.residualTolerance);
+        if(point.settled || (convergence.maxSteps > 0 && point.steps >= convergence.maxSteps)) {
+            pointIndex++;
+            frameTime = 0;
+        }
+        dt = calmStep ? std::min(dt * convergence.timeStepGrowth, std::max(convergence.maxTimeStep, convergence.timeStep)) : convergence.timeStep;
+        prevError = curError;
+    }
+    point.error = curError;
+    pointConvergence.push_back(point);
+    return curError;
+}
+
+double MMGrid::getPathError(double budget)
 {
     int pathStepsPerSec = 3;
-    double timeStep = 0.5 / 60;
     double totError = 0;
-    double haltDelta = 1e-4;
-    update_follow_path(timeStep, pathStepsPerSec);
+    update_follow_path(convergence.timeStep, pathStepsPerSec);
     calculatedPaths.clear();
+    convergedPoses.clear();
+    pointConvergence.clear();
+    lastIterations = 0;
+    bool warm = warmStart.size() == targetPaths[0].size();
     for (int i = 0; i < targetPaths.size(); i++) {
         calculatedPaths.push_back({});
     }
@@ -1356,24 +1678,22 @@ double MMGrid::getPathError()
     }
     for (int pathStep = 0; pathStep < targetPaths[0].size(); pathStep++)
     {
-        int numIterations = 0;
-        double curError = INT8_MAX, prevError = INT8_MAX;
         clock_t start, end;
         start = clock();
-        while(pointIndex < pathStep) {
-            update_follow_path(timeStep, pathStepsPerSec);
-            numIterations++;
-            curError = getCurrentError();
-            if(abs(prevError - curError) < haltDelta) {
-                pointIndex++;
-                frameTime = 0;
-            }
-            prevError = curError;
-        }
+        if (warm && pointIndex < pathStep)
+            applyLinkPose(warmStart[pathStep]);
+        double curError = settlePoint(pathStep, pathStepsPerSec);
+        int numIterations = pointConvergence.back().steps;
         recordPoints();
+        convergedPoses.push_back(linkPose());
+        lastIterations += numIterations;
         end = clock();
         cout << "For path step " << pathStep << " error is " << curError << " with " << numIterations << " iterations in " << double(end - start) / double(CLOCKS_PER_SEC) << " seconds." << endl;
         totError += curError;
+        if (totError > budget) {
+            cout << "Error " << totError << " exceeds budget " << budget << " after " << pathStep + 1 << " of " << targetPaths[0].size() << " path steps." << endl;
+            return totError;
+        }
     }
     cout << "Calculated Error: " << totError << endl;
     return totError;
@@ -1,33 +1,108 @@
 #define _CRT_SECURE_NO_WARNINGS
 
+#include <atomic>
+#include <cfloat>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
-#include <igl/opengl/glfw/Viewer.h>
+#include <Eigen/Dense>
 #include "chipmunk/chipmunk.h"
 #include "rendering.hpp"
 #include "ConstraintGraph.hpp"
+#include "SimulationProfile.hpp"
+#include "ParallelStepper.hpp"
+#include "GridSolver.hpp"
 
 #define SQRT_2 1.4142135623730950488016887242
 
 #pragma once
 
+// the viewer is only needed by MMGridRender.cpp, so the core library never pulls in libigl/GLFW
+namespace igl { namespace opengl { namespace glfw { class Viewer; } } }
+
 using namespace std;
 using namespace Eigen;
 
+// dynamic state of an MMGrid (see MMGrid::snapshot), only valid for the layout and parameters it was taken from
+struct MMGridState {
+    // per body: x, y, angle, vx, vy, angular velocity, 1 if in the space
+    vector<cpFloat> bodies;
+    vector<int> cells;
+    vector<int> constrainedJoints;
+    int pointIndex = 0;
+    cpFloat frameTime = 0;
+    // the grid's parameter generation when the snapshot was taken
+    unsigned long generation = 0;
+    bool empty() { return bodies.empty(); };
+};
+
+// when getPathError/getAnglesFor move on to the next path point; the defaults are the original criterion
+// (error change below haltDelta at a fixed time step)
+struct ConvergenceSettings {
+    // a step is calm when the target error changes by less than haltDelta and, if energyTolerance > 0,
+    // the links' kinetic energy is below energyTolerance; a point settles after calmSteps calm steps in a row
+    cpFloat haltDelta = 1e-4;
+    cpFloat energyTolerance = 0;
+    int calmSteps = 1;
+    // if > 0 a point also settles as soon as its target error is below residualTolerance
+    cpFloat residualTolerance = 0;
+    // every point starts at timeStep, calm steps grow it by timeStepGrowth up to maxTimeStep, others reset it
+    cpFloat timeStep = 0.5 / 60;
+    cpFloat maxTimeStep = 0.5 / 60;
+    cpFloat timeStepGrowth = 1.5;
+    // if > 0 a point that hasn't settled after maxSteps steps is left for the next one
+    int maxSteps = 0;
+    bool isDefault() const;
+};
+
+// how the last getPathError/getAnglesFor left one path point
+struct PointConvergence {
+    int steps = 0;
+    cpFloat error = 0;
+    // only measured with an energyTolerance
+    cpFloat kineticEnergy = 0;
+    // false if the step budget ran out or the playback moved on (after 1/3 s of simulated time) first
+    bool settled = false;
+};
+
 class MMGrid
 {
 private:
-    static int counter;
+    static std::atomic<int> counter;
     int mycounter;
     int rows;
     int cols;
     vector<int> cells;
-    cpSpace *space;
+    // created once per grid and emptied/refilled when the grid size changes
+    cpSpace *space = nullptr;
     cpFloat linkMass = 0.3;
     cpFloat bevel = .06;
     cpFloat stiffness = 0.6;
     cpFloat damping = 2;
+    // links only interact through their pivots and springs unless collisions are switched on
+    bool collisions = false;
+    SimulationProfile profile;
+    // with more than one thread, update steps the space with a ParallelStepper whenever it can
+    int stepThreads = 1;
+    std::unique_ptr<ParallelStepper> stepper;
+    // if set, update steps the space with it whenever it can (instead of the ParallelStepper or cpSpaceStep)
+    std::unique_ptr<GridSolver> gridSolver;
     vector<cpBody *> rowLinks, colLinks, crossLinks, joints, controllers;
+    // the two diagonal links of a rigid cell and the pivots holding them, per cell (null for other cells)
+    struct CrossBrace {
+        cpBody *links[2] = {nullptr, nullptr};
+        cpConstraint *pivots[4] = {nullptr, nullptr, nullptr, nullptr};
+    };
+    vector<CrossBrace> braces;
+    // damped rotary springs between neighbouring links, re-tuned in place by setStiffness/setDamping
+    vector<cpConstraint *> springs;
+    // the space's constraints in the order setupSimStructures added them, after the braces' pivots (which come first)
+    vector<cpConstraint *> baseConstraints;
+    // where every body was created, for resetToRest
+    std::unordered_map<cpBody *, cpVect> restPose;
     vector<int> constrainedJoints;
     vector<cpConstraint *> controllerConstraints;
     MatrixX2d vertices;
@@ -43,12 +118,26 @@ private:
     vector<int> targets;
     vector<vector<cpVect>> targetPaths;
     vector<vector<cpVect>> calculatedPaths;
+    // per path point: x, y, angle of every row and column link (see getConvergedPoses)
+    vector<vector<cpFloat>> warmStart;
+    vector<vector<cpFloat>> convergedPoses;
+    long lastIterations = 0;
+    ConvergenceSettings convergence;
+    vector<PointConvergence> pointConvergence;
+    double settlePoint(int pathStep, int pathStepsPerSec);
+    cpFloat linkKineticEnergy();
     vector<int> anchors;
     int resolution = 6;
     int shrink_factor = 2;
     cpFloat frameTime = 0;
     int pointIndex = 0;
+    // bumped by updateParameters: the links are reshaped and re-anchored, so older snapshots no longer fit
+    unsigned long generation = 0;
     std::pair<MatrixX3d, MatrixX3i> mesh;
+    // every link's capsule is this one, moved into place
+    CapsuleTemplate capsule;
+    // vertices and mesh lag behind the simulation until render asks for a frame
+    bool renderStale = true;
     int jointRows() { return rows + 1; };
     int jointCols() { return cols + 1; };
     int numRowLinks() { return jointRows() * cols; };
@@ -86,18 +175,21 @@ private:
         cpFloat moment = cpMomentForSegment(linkMass, a, b, bevel);
         cpBody *body = cpSpaceAddBody(space, cpBodyNew(linkMass, moment));
         cpBodySetPosition(body, posA);
+        restPose[body] = posA;
         return body;
     };
 
     cpBody *makeJointBody(cpVect pos) {
         cpBody *body = cpSpaceAddBody(space, cpBodyNew(linkMass / 10, INFINITY));
         cpBodySetPosition(body, pos);
+        restPose[body] = pos;
         return body;
     }
 
     cpBody *makeControllerBody(cpVect pos) {
         cpBody *body = cpSpaceAddBody(space, cpBodyNewKinematic());
         cpBodySetPosition(body, pos);
+        restPose[body] = pos;
         return body;
     }
 
@@ -112,9 +204,20 @@ private:
     }
 
     void setupSimStructures();
+    void addLinkShapes();
+    void removeLinkShapes();
     void removeSimStructures();
+    void addCrossLinks(int cellIndex);
+    void removeCrossLinks(int cellIndex);
+    void collectCrossLinks();
+    void setBraces(vector<int> cells);
+    void resetBodies();
+    void resetSolverState();
+    void updateParameters();
+    void reshapeLink(cpBody *body, cpVect posA, cpVect posB);
     void setupSpace()
     {
+        profile.apply(space);
         cpVect gravity = cpv(0, -9.8);
         // cpSpaceSetGravity(space, gravity);
 
@@ -131,14 +234,16 @@ private:
     void recordPoints();
     void updateCalculatedRenderPaths();
     void removeAllJointControllers();
+    vector<cpFloat> linkPose();
+    void applyLinkPose(const vector<cpFloat> &pose);
+    cpVect linkPoint(cpBody *link, int jointIndex) { return cpBodyLocalToWorld(link, getRestPosition(jointIndex) - restPose[link]); };
 
 public:
     bool changingStructure = false;
     MMGrid(int rows, int cols, vector<int> cells);
     MMGrid(const MMGrid& other) {
         cout << "Constructing Copy! " << counter << " of " << other.mycounter << endl;
-        mycounter = counter;
-        counter++;
+        mycounter = counter++;
         rows = other.rows;
         cols = other.cols;
         cells = other.cells;
@@ -146,50 +251,99 @@ public:
         targets = other.targets;
         targetPaths = other.targetPaths;
         anchors = other.anchors;
+        linkMass = other.linkMass;
+        bevel = other.bevel;
+        stiffness = other.stiffness;
+        damping = other.damping;
+        collisions = other.collisions;
+        profile = other.profile;
+        setStepThreads(other.stepThreads);
+        setGridSolver(other.gridSolver != nullptr);
+        shrink_factor = other.shrink_factor;
+        resolution = other.resolution;
+        convergence = other.convergence;
         vertices = MatrixXd::Zero(jointCols() * jointRows(), 2);
-        edges = MatrixXi::Zero(numColLinks() + numCrossLinks() + numRowLinks(), 2);
+        edges = MatrixXi::Zero(numColLinks() + numCrossLinks() + numRowLinks() + numActiveLinks(), 2);
         pointColors = MatrixXd::Zero(vertices.rows(), 3);
         edgeColors = MatrixXd::Zero(edges.rows(), 3);
         setupSimStructures();
-        updateVertices();
-        updateMesh();
-        updateEdges();        
+        updateEdges();
     }
+    // grids own their cpSpace, a member-wise assignment would free it twice
+    MMGrid& operator=(const MMGrid& other) = delete;
     ~MMGrid();
     void render(igl::opengl::glfw::Viewer *viewer, int selected_cell, int selected_joint);
-    void render(igl::opengl::glfw::Viewer viewer, int selected_cell);
+    // advances the simulation only, the render data is rebuilt by the next render
     void update(cpFloat dt);
     void update_follow_path(cpFloat dt, int points_per_second);
+    // a grid of the same size keeps its cpSpace and bodies: it is reset to rest and only the cross-links
+    // of cells that become or stop being rigid are added or removed; other sizes rebuild the space's contents
     void setCells(int rows, int cols, vector<int> cells);
+    // setCells for the same grid size that also drops the calculated paths, used to evaluate candidates
+    void applyCells(vector<int> cells);
+    // adds or removes one cell's cross-links, the grid should be at rest
+    void setCellRigid(int cellIndex, bool rigid);
+    // puts every body back where it was created, at rest, and releases all joint controllers
+    void resetToRest();
+    // positions, angles and velocities of all bodies (controllers included), the held joints and the playback position
+    MMGridState snapshot();
+    // returns to a snapshot of the same layout and parameters (false, and nothing changes, if either differs)
+    bool restore(const MMGridState &state);
     void applyForce(int direction, int selected_cell);
+    // the parameter setters update the existing bodies and constraints and put the grid back at rest
     cpFloat getLinkMass() {return linkMass;};
     void setLinkMass(cpFloat linkMass) {
         this->linkMass = linkMass;
-        setCells(rows, cols, cells);
+        updateParameters();
     };
     cpFloat getBevel() {return bevel;};
     void setBevel(cpFloat bevel) {
         this->bevel = bevel;
-        setCells(rows, cols, cells);
+        updateParameters();
     };
     cpFloat getStiffness() {return stiffness;};
     void setStiffness(cpFloat stiffness) {
         this->stiffness = stiffness;
-        setCells(rows, cols, cells);
+        updateParameters();
     };
     cpFloat getDamping() {return damping;};
     void setDamping(cpFloat damping) {
         this->damping = damping;
-        setCells(rows, cols, cells);
+        updateParameters();
+    };
+    // collision shapes on the row and column links, off by default; without them Chipmunk skips its spatial index
+    // and collision detection entirely
+    bool getCollisions() {return collisions;};
+    void setCollisions(bool collisions);
+    // Chipmunk solver settings, applied to the space right away
+    SimulationProfile getProfile() {return profile;};
+    void setProfile(SimulationProfile profile) {
+        this->profile = profile;
+        profile.apply(space);
     };
+    // threads stepping the space; results are the same for any count above one, but differ slightly from a single
+    // thread's (see ParallelStepper). Spaces with link collisions or sleeping bodies are always stepped on one thread.
+    int getStepThreads() {return stepThreads;};
+    void setStepThreads(int stepThreads);
+    // whether update currently uses the ParallelStepper
+    bool isParallelStepping() {return !isGridSolving() && stepper && stepper->canStep(space);};
+    // structure-of-arrays solver for the grid's pivots and springs (see GridSolver), single-threaded; its results
+    // match the ParallelStepper's up to rounding. Same fallback to cpSpaceStep as with step threads.
+    bool getGridSolver() {return gridSolver != nullptr;};
+    void setGridSolver(bool enabled) {gridSolver.reset(enabled ? new GridSolver() : nullptr);};
+    // whether update currently uses the GridSolver
+    bool isGridSolving() {return gridSolver && gridSolver->canStep(space);};
     int getShrinkFactor() {return shrink_factor;};
     void setShrinkFactor(int shrink_factor) {
         this->shrink_factor = shrink_factor;
-        setCells(rows, cols, cells);
+        updateParameters();
     };
     int getRows() {return rows;};
     int getCols() {return cols;};
     vector<int> getCells() {return cells;}
+    vector<int> getAnchors() {return anchors;};
+    // position of a joint in the undeformed grid
+    cpVect getRestPosition(int jointIndex) {return bottomLeft + getJointOffset(jointIndex);};
     void nextPoint() {
         pointIndex++;
         if (targetPaths.size() > 0) {
@@ -204,6 +358,7 @@ public:
     };
     void addJointController(int jointIndex);
     void removeJointController(int jointIndex);
+    // where a held joint is being pulled to (its controller), or where a free joint is
     cpVect getPos(int jointIndex);
     void moveController(int jointIndex, cpVect pos);
     bool isConstrained(int jointIndex);
@@ -211,11 +366,28 @@ public:
     void loadFromFile(const std::string fname);
     void loadPath(const std::string fname, int target);
     void setPath(vector<cpVect> path, int target);
+    // replaces all target paths verbatim (setPath moves a path to start at its joint)
+    void setTargetPaths(vector<int> targets, vector<vector<cpVect>> targetPaths);
     void scalePath(float scale, int target);
     void removePath(int target);
     vector<cpVect> readPath(const std::string fname);
     vector<cpVect> getPathFor(int jointIndex);
-    double getPathError();
+    vector<int> getTargets() {return targets;};
+    vector<vector<cpVect>> getTargetPaths() {return targetPaths;};
+    // stops after the first path point that pushes the accumulated error above budget;
+    // a result above budget is then only a lower bound and calculatedPaths is partial
+    double getPathError(double budget = DBL_MAX);
+    // link poses getPathError converged to at every path point, to warm start another layout of the same grid
+    vector<vector<cpFloat>> getConvergedPoses() {return convergedPoses;};
+    // getPathError starts every path point from these poses (cross-links placed between the joints they imply)
+    // instead of from where the previous point left off; empty or from another path to switch it off
+    void setWarmStart(vector<vector<cpFloat>> poses) {warmStart = poses;};
+    // simulation steps of the last getPathError
+    long getLastIterations() {return lastIterations;};
+    ConvergenceSettings getConvergence() {return convergence;};
+    void setConvergence(ConvergenceSettings convergence) {this->convergence = convergence;};
+    // one entry per path point of the last getPathError/getAnglesFor (the first point is never simulated)
+    vector<PointConvergence> getPointConvergence() {return pointConvergence;};
     double getCurrentError();
     void resetAnimation();
     vector<vector<double>> getAnglesFor(vector<int> cellIndices);
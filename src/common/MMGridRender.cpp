@@ -0,0 +1,121 @@
+#include <igl/opengl/glfw/Viewer.h>
+#include "MMGrid.hpp"
+
+void MMGrid::render(igl::opengl::glfw::Viewer *viewer, int selected_cell, int selected_joint)
+{
+    while (changingStructure)
+    {
+        cout << "Waiting for finish changing structure..." << endl;
+    }
+    if (renderStale)
+    {
+        updateVertices();
+        updateMesh();
+        renderStale = false;
+    }
+    pointColors = MatrixXd::Zero(vertices.rows(), 3);
+    edgeColors = MatrixXd::Zero(edges.rows(), 3);
+
+    pointColors.row(selected_joint) += (Vector3d() << 1, 0, 0).finished();
+    for (int index : constrainedJoints)
+    {
+        pointColors.row(index) += (Vector3d() << 0, 0, 1).finished();
+    }
+
+    int edge_index = 0;
+
+    bool u_selection_done = false;
+    bool r_selection_done = false;
+    // update edge colors
+    for (int i = 0; i < rows * cols; i++)
+    {
+        if (i == selected_cell)
+            edgeColors.row(edge_index) += (Vector3d() << 1, 0, 0).finished();
+        else if (!u_selection_done && i == (selected_cell + cols))
+        {
+            edgeColors.row(edge_index) += (Vector3d() << 1, 0, 0).finished();
+            u_selection_done = true;
+        }
+        edge_index++;
+        if (i == selected_cell)
+            edgeColors.row(edge_index) += (Vector3d() << 1, 0, 0).finished();
+        else if (!r_selection_done && i == (selected_cell + 1))
+        {
+            edgeColors.row(edge_index) += (Vector3d() << 1, 0, 0).finished();
+            r_selection_done = true;
+        }
+        edge_index++;
+        if ((i + 1) % cols == 0)
+        {
+            if (i == selected_cell)
+            {
+                edgeColors.row(edge_index) += (Vector3d() << 1, 0, 0).finished();
+                r_selection_done = true;
+            }
+            edge_index++;
+        }
+        if (i >= (cols * (rows - 1)))
+        {
+            if (i == selected_cell)
+            {
+                edgeColors.row(edge_index) += (Vector3d() << 1, 0, 0).finished();
+                u_selection_done = true;
+            }
+            edge_index++;
+        }
+        if (cells[i] == 1)
+        {
+            edgeColors.row(edge_index) += (Vector3d() << 0, 0, 1).finished();
+            edge_index++;
+            edgeColors.row(edge_index) += (Vector3d() << 0, 0, 1).finished();
+            edge_index++;
+        }
+    }
+
+    MatrixX3d points = MatrixXd::Zero(vertices.rows(), 3);
+    points << vertices, MatrixXd::Zero(vertices.rows(), 1);
+
+    MatrixX3d edgePoints = MatrixXd::Zero(vertices.rows(), 3);
+    MatrixX3d edgeColors2 = MatrixXd::Zero(edgeColors.rows(), 3);
+    MatrixX2i edges2 = MatrixXi::Zero(edges.rows(), 2);
+    if (targetVerts.rows() == 0)
+    {
+        edgePoints << points;
+        edges2 << edges;
+        edgeColors2 << edgeColors;
+    }
+    else
+    {
+        if (calcVerts.rows() == 0) {
+            //cout << "No calc" << endl;
+            MatrixX2d intermediate = MatrixXd::Zero(vertices.rows() + targetVerts.rows(), 2);
+            intermediate << vertices, targetVerts;
+            edgePoints = MatrixXd::Zero(intermediate.rows(), 3);
+            edgePoints << intermediate, MatrixXd::Zero(intermediate.rows(), 1);
+            edges2 = MatrixXi::Zero(edges.rows() + targetEdges.rows(), 2);
+            edges2 << edges, targetEdges + MatrixXi::Constant(targetEdges.rows(), 2, vertices.rows());
+            edgeColors2 = MatrixXd::Zero(edges.rows() + targetEdges.rows(), 3);
+            edgeColors2 << edgeColors, MatrixXd::Zero(targetEdges.rows(), 3);
+        }
+        else {
+            //cout << "No calc" << endl;
+            MatrixX2d intermediate = MatrixXd::Zero(vertices.rows() + targetVerts.rows() + calcVerts.rows(), 2);
+            intermediate << vertices, targetVerts, calcVerts;
+            edgePoints = MatrixXd::Zero(intermediate.rows(), 3);
+            edgePoints << intermediate, MatrixXd::Zero(intermediate.rows(), 1);
+            edges2 = MatrixXi::Zero(edges.rows() + targetEdges.rows() + calcEdges.rows(), 2);
+            edges2 << edges, targetEdges + MatrixXi::Constant(targetEdges.rows(), 2, vertices.rows()), calcEdges + MatrixXi::Constant(calcEdges.rows(), 2, vertices.rows() + targetVerts.rows());
+            edgeColors2 = MatrixXd::Zero(edges.rows() + targetEdges.rows() + calcEdges.rows(), 3);
+            edgeColors2 << edgeColors, MatrixXd::Zero(targetEdges.rows() + calcEdges.rows(), 3);
+        }
+    }
+    MatrixX3d faceColors(mesh.second.rows(), 3);
+    for (int i = 0; i < faceColors.rows(); i++) {
+        faceColors.row(i) = Vector3d(.231, .231, .231);
+    }
+    viewer->data().clear();
+    viewer->data().set_points(points, pointColors);
+    viewer->data().set_edges(edgePoints, edges2, edgeColors2);
+    viewer->data().set_mesh(mesh.first, mesh.second);
+    viewer->data().set_colors(faceColors);
+}
@@ -1,7 +1,22 @@
 #include "PRand.hpp"
 #include <cstdlib>
 
-using std::rand;
+std::mt19937& randomEngine() {
+    static thread_local std::mt19937 engine(std::random_device{}());
+    return engine;
+}
+
+void seedRandom(unsigned int seed) {
+    randomEngine().seed(seed);
+}
+
+int randomInt(int n) {
+    return std::uniform_int_distribution<int>(0, n - 1)(randomEngine());
+}
+
+double randomUniform() {
+    return std::uniform_real_distribution<double>(0.0, 1.0)(randomEngine());
+}
 
 PRand::PRand(int N) : N{N} {
     acc = 0;
@@ -9,9 +24,9 @@ PRand::PRand(int N) : N{N} {
 }
 
 int PRand::next() {
-    int i = rand() % (N - acc) + acc;
+    int i = randomInt(N - acc) + acc;
     int n = store[i] == 0 ? i + 1 : store[i];
     store[i] = store[acc] == 0 ? acc + 1 : store[acc];
     acc++;
     return n - 1;
-}
\ No newline at end of file
+}
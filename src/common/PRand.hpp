@@ -1,9 +1,19 @@
+#include<random>
 #include<vector>
 
 #pragma once
 
 using std::vector;
 
+// Per-thread random engine used by PRand, ConstraintGraph and the optimizers,
+// so concurrent chains never share (or race on) rand()'s global state.
+std::mt19937& randomEngine();
+void seedRandom(unsigned int seed);
+// uniform in [0, n)
+int randomInt(int n);
+// uniform in [0, 1)
+double randomUniform();
+
 class PRand {
     private:
         int acc;
@@ -12,4 +22,4 @@ class PRand {
     public:
         PRand(int N);
         int next();
-};
\ No newline at end of file
+};
@@ -0,0 +1,146 @@
+#include "ParallelStepper.hpp"
+#include "chipmunk/chipmunk_structs.h"
+#include <algorithm>
+#include <cmath>
+
+ParallelStepper::ParallelStepper(int numThreads) : numThreads(std::max(1, numThreads)) {
+    workers.reserve(this->numThreads - 1);
+    for (int t = 1; t < this->numThreads; t++)
+        workers.emplace_back(&ParallelStepper::work, this, t);
+}
+
+ParallelStepper::~ParallelStepper() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+bool ParallelStepper::colorsCurrent(cpSpace *space) {
+    cpArray *constraints = space->constraints;
+    if (colored.size() != constraints->num)
+        return false;
+    for (int i = 0; i < constraints->num; i++)
+    {
+        cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+        if (colored[i].constraint != constraint || colored[i].a != constraint->a || colored[i].b != constraint->b)
+            return false;
+    }
+    return true;
+}
+
+void ParallelStepper::buildColors(cpSpace *space) {
+    cpArray *constraints = space->constraints;
+    colored.clear();
+    colors.clear();
+    callbacks = false;
+    std::vector<std::pair<cpBody *, cpBody *>> bodies;
+    for (int i = 0; i < constraints->num; i++)
+    {
+        cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+        colored.push_back({ constraint, constraint->a, constraint->b });
+        bodies.push_back({ constraint->a, constraint->b });
+        callbacks = callbacks || constraint->preSolve || constraint->postSolve;
+    }
+    std::vector<int> colorOf = colorConstraints(bodies);
+    for (int i = 0; i < colorOf.size(); i++)
+    {
+        if (colors.size() <= colorOf[i])
+            colors.resize(colorOf[i] + 1);
+        colors[colorOf[i]].push_back(colored[i].constraint);
+    }
+}
+
+bool ParallelStepper::canStep(cpSpace *space) {
+    if (space->sleepTimeThreshold != INFINITY || space->arbiters->num > 0 || cpSpatialIndexCount(space->dynamicShapes) > 0)
+        return false;
+    if (!colorsCurrent(space))
+        buildColors(space);
+    return !callbacks;
+}
+
+bool ParallelStepper::step(cpSpace *space, cpFloat dt) {
+    if (!canStep(space))
+        return false;
+    if (dt == 0)
+        return true;
+    // what cpSpaceStep does besides collision handling and sleeping, neither of which can happen here
+    space->stamp++;
+    cpFloat prevDt = space->curr_dt;
+    space->curr_dt = dt;
+    this->space = space;
+    this->dt = dt;
+    dtCoef = prevDt == 0 ? 0 : dt / prevDt;
+    space->locked++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        steps++;
+    }
+    wake.notify_all();
+    runStep(0);
+    space->locked--;
+    return true;
+}
+
+void ParallelStepper::work(int thread) {
+    unsigned long done = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this, done]() { return stopping || steps != done; });
+            if (stopping)
+                return;
+            done = steps;
+        }
+        runStep(thread);
+    }
+}
+
+void ParallelStepper::barrier() {
+    unsigned long current = phase.load(std::memory_order_acquire);
+    if (arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == numThreads)
+    {
+        arrived.store(0, std::memory_order_relaxed);
+        phase.fetch_add(1, std::memory_order_release);
+        return;
+    }
+    while (phase.load(std::memory_order_acquire) == current)
+        std::this_thread::yield();
+}
+
+// the phases of cpSpaceStep in its order, each ending at a barrier; bodies are integrated independently, constraints
+// a color at a time. Damped springs already apply their spring impulse in preStep, so preStep is colored as well.
+void ParallelStepper::runStep(int thread) {
+    cpArray *bodies = space->dynamicBodies;
+    forRange(bodies->num, thread, [this, bodies](int i) {
+        cpBody *body = (cpBody *)bodies->arr[i];
+        body->position_func(body, dt);
+    });
+    barrier();
+    for (std::vector<cpConstraint *>& color : colors)
+    {
+        forRange(color.size(), thread, [this, &color](int i) { color[i]->klass->preStep(color[i], dt); });
+        barrier();
+    }
+    cpFloat damping = pow(space->damping, dt);
+    cpVect gravity = space->gravity;
+    forRange(bodies->num, thread, [this, bodies, damping, gravity](int i) {
+        cpBody *body = (cpBody *)bodies->arr[i];
+        body->velocity_func(body, gravity, damping, dt);
+    });
+    barrier();
+    for (std::vector<cpConstraint *>& color : colors)
+    {
+        forRange(color.size(), thread, [this, &color](int i) { color[i]->klass->applyCachedImpulse(color[i], dtCoef); });
+        barrier();
+    }
+    for (int iteration = 0; iteration < space->iterations; iteration++)
+        for (std::vector<cpConstraint *>& color : colors)
+        {
+            forRange(color.size(), thread, [this, &color](int i) { color[i]->klass->applyImpulse(color[i], dt); });
+            barrier();
+        }
+}
@@ -0,0 +1,86 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "chipmunk/chipmunk.h"
+
+#pragma once
+
+// Multithreaded cpSpaceStep for spaces without collision shapes (links only interact through constraints).
+// The constraints are colored so that no two of a color share a body, then every solver pass goes through the
+// colors in turn with each color's constraints split between the threads. Constraints of one color touch disjoint
+// bodies, so a step's result doesn't depend on the thread count or on scheduling; it does differ slightly from
+// cpSpaceStep, which solves the constraints in the order they were added instead of color by color.
+class ParallelStepper {
+    private:
+        // the calling thread is thread 0, the workers are threads 1 to numThreads - 1
+        int numThreads;
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        unsigned long steps = 0;
+        bool stopping = false;
+        // spin barrier between the phases of a step
+        std::atomic<int> arrived{0};
+        std::atomic<unsigned long> phase{0};
+        // the step in progress
+        cpSpace *space = nullptr;
+        cpFloat dt = 0;
+        cpFloat dtCoef = 0;
+        // the space's constraints (and their bodies) when the colors were built, to notice when they change
+        struct ColoredConstraint {
+            cpConstraint *constraint;
+            cpBody *a, *b;
+        };
+        std::vector<ColoredConstraint> colored;
+        std::vector<std::vector<cpConstraint *>> colors;
+        // constraints with solve callbacks are left to cpSpaceStep
+        bool callbacks = false;
+        bool colorsCurrent(cpSpace *space);
+        void buildColors(cpSpace *space);
+        void work(int thread);
+        void runStep(int thread);
+        void barrier();
+        template <typename F>
+        void forRange(int n, int thread, F f) {
+            int end = (long)n * (thread + 1) / numThreads;
+            for (int i = (long)n * thread / numThreads; i < end; i++)
+                f(i);
+        };
+    public:
+        ParallelStepper(int numThreads);
+        ~ParallelStepper();
+        int getNumThreads() { return numThreads; };
+        // false, without stepping, if the space has collision shapes, lets bodies sleep or has constraint callbacks
+        bool canStep(cpSpace *space);
+        // steps the space like cpSpaceStep, or returns false like canStep
+        bool step(cpSpace *space, cpFloat dt);
+        int getNumColors() { return colors.size(); };
+        // greedy coloring in the given order: every constraint, given by the two bodies it joins, gets the first color
+        // neither of its bodies has yet; returns each constraint's color
+        template <typename Body>
+        static std::vector<int> colorConstraints(const std::vector<std::pair<Body, Body>>& constraints) {
+            std::vector<int> colorOf;
+            colorOf.reserve(constraints.size());
+            std::unordered_map<Body, std::vector<bool>> used;
+            for (const std::pair<Body, Body>& bodies : constraints)
+            {
+                std::vector<bool>& usedA = used[bodies.first];
+                std::vector<bool>& usedB = used[bodies.second];
+                int color = 0;
+                while ((color < usedA.size() && usedA[color]) || (color < usedB.size() && usedB[color]))
+                    color++;
+                for (std::vector<bool>* bodyColors : { &usedA, &usedB })
+                {
+                    if (bodyColors->size() <= color)
+                        bodyColors->resize(color + 1, false);
+                    (*bodyColors)[color] = true;
+                }
+                colorOf.push_back(color);
+            }
+            return colorOf;
+        };
+};
@@ -0,0 +1,143 @@
+#include "ParallelTempering.hpp"
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include "PRand.hpp"
+#include "ThreadPool.hpp"
+
+ParallelTempering::ParallelTempering(std::vector<MMGrid> startGrids, double dofWeight, double pathWeight, int numReplicas) : simGrids(startGrids), pathWeight(pathWeight), dofWeight(dofWeight), numReplicas(numReplicas)
+{
+    if (this->numReplicas <= 0)
+        this->numReplicas = std::max(2u, std::thread::hardware_concurrency());
+}
+
+void ParallelTempering::runChain(Replica& replica, int numIterations)
+{
+    // chains hop between pool threads, so each one carries its own engine state
+    std::mt19937 threadEngine = randomEngine();
+    randomEngine() = replica.engine;
+    int rows = replica.pathSets[0].getRows(), cols = replica.pathSets[0].getCols();
+    for (int i = 0; i < numIterations; i++)
+    {
+        ConstraintGraph cg(rows, cols, replica.cells);
+        cg.mutate();
+        vector<int> candCells = cg.makeCells();
+        // u < exp((err - newErr) / T)  <=>  newErr < err - T * log(u), anything above that is rejected
+        double u = randomUniform();
+        double budget = u > 0 ? replica.err - replica.temperature * log(u) : DBL_MAX;
+        Evaluation cand = replica.evaluator->evaluate(candCells, budget);
+        if (cand.aborted)
+            continue;
+        if (cand.error < replica.bestErr)
+        {
+            replica.bestErr = cand.error;
+            replica.bestCells = candCells;
+            replica.bestCalculatedPaths = cand.calculatedPaths;
+        }
+        if (cand.error < replica.err || u < exp((replica.err - cand.error) / replica.temperature))
+        {
+            replica.cells = candCells;
+            replica.err = cand.error;
+            replica.accepted++;
+        }
+    }
+    replica.engine = randomEngine();
+    randomEngine() = threadEngine;
+}
+
+MMGrid ParallelTempering::simulate(int numIterations)
+{
+    seedRandom(time(NULL));
+    int rows = simGrids[0].getRows(), cols = simGrids[0].getCols();
+    // one cache for all replicas, chains at neighbouring temperatures revisit each other's layouts
+    FitnessCache runCache;
+    FitnessCache* fitnessCache = cache ? cache : &runCache;
+    CandidateEvaluator startEvaluator(simGrids, pathWeight, dofWeight);
+    startEvaluator.setQuasiStatic(quasiStatic);
+    startEvaluator.setCache(fitnessCache);
+    startEvaluator.setPersistentCache(store);
+    Evaluation start = startEvaluator.evaluate(simGrids[0].getCells());
+
+    std::vector<std::unique_ptr<Replica>> replicas;
+    for (int r = 0; r < numReplicas; r++)
+    {
+        std::unique_ptr<Replica> replica = std::make_unique<Replica>(simGrids);
+        // the replicas already occupy every thread, so each one simulates its path sets serially
+        replica->evaluator = std::make_unique<CandidateEvaluator>(replica->pathSets, pathWeight, dofWeight, 1);
+        replica->evaluator->setQuasiStatic(quasiStatic);
+        replica->evaluator->setCache(fitnessCache);
+        replica->evaluator->setPersistentCache(store);
+        replica->engine.seed(randomEngine()());
+        replica->temperature = numReplicas == 1 ? minTemp : minTemp * pow(maxTemp / minTemp, (double)r / (numReplicas - 1));
+        replica->cells = simGrids[0].getCells();
+        replica->err = start.error;
+        replica->bestCells = replica->cells;
+        replica->bestErr = start.error;
+        replica->bestCalculatedPaths = start.calculatedPaths;
+        replicas.push_back(std::move(replica));
+    }
+
+    ThreadPool pool(numReplicas);
+    vector<int> swapAttempts(numReplicas), swapsAccepted(numReplicas);
+    int round = 0;
+    for (int done = 0; done < numIterations; done += swapInterval)
+    {
+        int roundIterations = std::min(swapInterval, numIterations - done);
+        std::vector<std::future<void>> chains;
+        for (auto& replica : replicas)
+        {
+            Replica* r = replica.get();
+            chains.push_back(pool.submit([this, r, roundIterations]() { runChain(*r, roundIterations); }));
+        }
+        for (auto& chain : chains)
+            chain.get();
+
+        // alternate even/odd neighbour pairs so every pair gets a chance to exchange
+        for (int r = round % 2; r + 1 < numReplicas; r += 2)
+        {
+            Replica& cold = *replicas[r];
+            Replica& hot = *replicas[r + 1];
+            double delta = (cold.err - hot.err) * (1.0 / cold.temperature - 1.0 / hot.temperature);
+            swapAttempts[r]++;
+            if (delta >= 0 || randomUniform() < exp(delta))
+            {
+                std::swap(cold.cells, hot.cells);
+                std::swap(cold.err, hot.err);
+                swapsAccepted[r]++;
+            }
+        }
+        std::cout << "Round " << round << " (" << done + roundIterations << " of " << numIterations << " iterations), errors:";
+        for (auto& replica : replicas)
+            std::cout << " " << replica->err;
+        std::cout << std::endl;
+        round++;
+    }
+
+    Replica* best = replicas[0].get();
+    for (auto& replica : replicas)
+    {
+        std::cout << "Replica at T = " << replica->temperature << ": accepted " << replica->accepted << " of " << numIterations << ", best error " << replica->bestErr << std::endl;
+        if (replica->bestErr < best->bestErr)
+            best = replica.get();
+    }
+    for (int r = 0; r + 1 < numReplicas; r++)
+        std::cout << "Swaps between T = " << replicas[r]->temperature << " and " << replicas[r + 1]->temperature << ": " << swapsAccepted[r] << " of " << swapAttempts[r] << std::endl;
+
+    long evaluated = 0, aborted = 0, prescreened = 0;
+    for (auto& replica : replicas)
+    {
+        evaluated += replica->evaluator->getEvaluated();
+        aborted += replica->evaluator->getAborted();
+        prescreened += replica->evaluator->getPrescreened();
+    }
+    std::cout << "Stopped " << aborted << " of " << evaluated << " simulations early" << std::endl;
+    std::cout << "Prescreen avoided " << prescreened << " simulations" << std::endl;
+    fitnessCache->printStats();
+    if (store)
+        store->printStats();
+    bestErr = best->bestErr;
+    calculatedPaths = best->bestCalculatedPaths;
+    std::cout << "Best weighted error is " << bestErr << std::endl;
+    simGrids[0].setCells(rows, cols, best->bestCells);
+    return simGrids[0];
+}
@@ -0,0 +1,57 @@
+#include <memory>
+#include <random>
+#include "MMGrid.hpp"
+#include "CandidateEvaluator.hpp"
+
+#pragma once
+
+// Replica exchange: one Metropolis chain per temperature, each on its own thread with its own
+// copies of the path sets, swapping layouts between neighbouring temperatures every swapInterval iterations.
+class ParallelTempering {
+    private:
+        struct Replica {
+            std::vector<MMGrid> pathSets;
+            std::unique_ptr<CandidateEvaluator> evaluator;
+            std::mt19937 engine;
+            double temperature;
+            vector<int> cells;
+            double err;
+            vector<int> bestCells;
+            double bestErr;
+            vector<vector<vector<cpVect>>> bestCalculatedPaths;
+            int accepted = 0;
+            Replica(std::vector<MMGrid>& startGrids) : pathSets(startGrids) {};
+        };
+        std::vector<MMGrid> simGrids;
+        double pathWeight;
+        double dofWeight;
+        int numReplicas;
+        double minTemp = 0.5;
+        double maxTemp = 50;
+        int swapInterval = 5;
+        FitnessCache* cache = nullptr;
+        PersistentCache* store = nullptr;
+        bool quasiStatic = false;
+        double bestErr;
+        vector<vector<vector<cpVect>>> calculatedPaths;
+        void runChain(Replica& replica, int numIterations);
+    public:
+        // numReplicas <= 0 uses one replica per hardware core
+        ParallelTempering(std::vector<MMGrid> startGrids, double dofWeight, double pathWeight, int numReplicas = 0);
+        // temperatures are spaced geometrically between minTemp and maxTemp
+        void setTemperatures(double minTemp, double maxTemp) {
+            this->minTemp = minTemp;
+            this->maxTemp = maxTemp;
+        };
+        void setSwapInterval(int swapInterval) { this->swapInterval = std::max(1, swapInterval); };
+        // evaluations are memoized in cache (kept across runs); without one, each run uses its own
+        void setCache(FitnessCache* cache) { this->cache = cache; };
+        // on-disk evaluation store shared with other runs and processes
+        void setPersistentCache(PersistentCache* store) { this->store = store; };
+        // evaluate with QuasiStaticSolver instead of the Chipmunk simulation
+        void setQuasiStatic(bool quasiStatic) { this->quasiStatic = quasiStatic; };
+        // numIterations is per replica
+        MMGrid simulate(int numIterations);
+        double getBestError() { return bestErr; };
+        vector<vector<vector<cpVect>>> getCalculatedPaths() { return calculatedPaths; };
+};
@@ -0,0 +1,286 @@
+#include "PersistentCache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char FILE_MAGIC[8] = {'D', 'M', 'M', 'C', 'A', 'C', 'H', '1'};
+static const uint32_t RECORD_MAGIC = 0x524D4D44; // "DMMR"
+
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t payloadBytes;
+    uint64_t designHash;
+    uint64_t contextHash;
+    double pathError;
+    int32_t dofs;
+    // over the fields above and the payload
+    uint32_t checksum;
+};
+
+static uint32_t checksum(const char* data, size_t size, uint32_t h = 2166136261u)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t recordChecksum(RecordHeader header, const char* payload)
+{
+    header.checksum = 0;
+    return checksum(payload, header.payloadBytes, checksum((const char*)&header, sizeof(RecordHeader)));
+}
+
+template <typename T>
+static void appendBytes(std::vector<char>& buffer, T value)
+{
+    const char* bytes = (const char*)&value;
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+static T readBytes(const char*& data)
+{
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+}
+
+uint64_t PersistentCache::hash(const std::string& key)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : key)
+    {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+#ifndef _WIN32
+
+PersistentCache::PersistentCache(std::string filePath, bool storePaths) : filePath(filePath), storePaths(storePaths)
+{
+    fd = open(filePath.c_str(), O_RDWR | O_APPEND | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        std::cout << "could not open evaluation cache " << filePath << std::endl;
+        return;
+    }
+    flock(fd, LOCK_EX);
+    struct stat st;
+    fstat(fd, &st);
+    if (st.st_size == 0)
+    {
+        if (write(fd, FILE_MAGIC, sizeof(FILE_MAGIC)) != sizeof(FILE_MAGIC))
+            std::cout << "could not initialize evaluation cache " << filePath << std::endl;
+    }
+    flock(fd, LOCK_UN);
+    std::lock_guard<std::mutex> lock(storeMutex);
+    refresh();
+    if (mappedSize < sizeof(FILE_MAGIC) || std::memcmp(mapped, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+    {
+        std::cout << filePath << " is not an evaluation cache" << std::endl;
+        if (mapped)
+            munmap((void*)mapped, mappedSize);
+        mapped = nullptr;
+        close(fd);
+        fd = -1;
+        return;
+    }
+    std::cout << "Opened evaluation cache " << filePath << " with " << offsets.size() << " records" << std::endl;
+}
+
+PersistentCache::~PersistentCache()
+{
+    if (mapped)
+        munmap((void*)mapped, mappedSize);
+    if (fd >= 0)
+        close(fd);
+}
+
+void PersistentCache::refresh()
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size <= mappedSize)
+        return;
+    if (mapped)
+        munmap((void*)mapped, mappedSize);
+    void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED)
+    {
+        mapped = nullptr;
+        mappedSize = 0;
+        return;
+    }
+    mapped = (const char*)m;
+    mappedSize = st.st_size;
+    indexRecords();
+}
+
+void PersistentCache::append(uint64_t designHash, uint64_t contextHash, const Evaluation& result)
+{
+    if (fd < 0)
+        return;
+    std::vector<char> payload;
+    if (storePaths)
+    {
+        appendBytes<uint32_t>(payload, result.calculatedPaths.size());
+        for (auto& setPaths : result.calculatedPaths)
+        {
+            appendBytes<uint32_t>(payload, setPaths.size());
+            for (auto& path : setPaths)
+            {
+                appendBytes<uint32_t>(payload, path.size());
+                for (cpVect p : path)
+                {
+                    appendBytes<double>(payload, p.x);
+                    appendBytes<double>(payload, p.y);
+                }
+            }
+        }
+    }
+    RecordHeader header = {RECORD_MAGIC, (uint32_t)payload.size(), designHash, contextHash, result.pathError, result.dofs, 0};
+    header.checksum = recordChecksum(header, payload.data());
+    std::vector<char> record((const char*)&header, (const char*)&header + sizeof(RecordHeader));
+    record.insert(record.end(), payload.begin(), payload.end());
+
+    // O_APPEND + one write per record under an exclusive lock keeps records from different processes whole
+    flock(fd, LOCK_EX);
+    ssize_t written = write(fd, record.data(), record.size());
+    flock(fd, LOCK_UN);
+    if (written != (ssize_t)record.size())
+    {
+        std::cout << "could not append to evaluation cache " << filePath << std::endl;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(storeMutex);
+    appended++;
+}
+
+#else
+
+PersistentCache::PersistentCache(std::string filePath, bool storePaths) : filePath(filePath), storePaths(storePaths)
+{
+    std::cout << "persistent evaluation caches are not supported on this platform, " << filePath << " is ignored" << std::endl;
+}
+
+PersistentCache::~PersistentCache() {}
+
+void PersistentCache::refresh() {}
+
+void PersistentCache::append(uint64_t designHash, uint64_t contextHash, const Evaluation& result) {}
+
+#endif
+
+bool PersistentCache::validRecordAt(size_t offset)
+{
+    if (offset + sizeof(RecordHeader) > mappedSize)
+        return false;
+    RecordHeader header;
+    std::memcpy(&header, mapped + offset, sizeof(RecordHeader));
+    return header.magic == RECORD_MAGIC && offset + sizeof(RecordHeader) + header.payloadBytes <= mappedSize &&
+        recordChecksum(header, mapped + offset + sizeof(RecordHeader)) == header.checksum;
+}
+
+void PersistentCache::indexRecords()
+{
+    size_t offset = std::max(indexedSize, sizeof(FILE_MAGIC));
+    while (offset + sizeof(RecordHeader) <= mappedSize)
+    {
+        RecordHeader header;
+        std::memcpy(&header, mapped + offset, sizeof(RecordHeader));
+        size_t end = offset + sizeof(RecordHeader) + header.payloadBytes;
+        if (header.magic == RECORD_MAGIC && end > mappedSize)
+        {
+            // the rest of the last record may not be visible yet; one with a whole record after it isn't being
+            // written but has a garbage length, and is skipped like any other corrupt record
+            bool followed = false;
+            for (size_t next = offset + 1; next + sizeof(RecordHeader) <= mappedSize && !followed; next++)
+                followed = validRecordAt(next);
+            if (!followed)
+                break;
+            offset++;
+            continue;
+        }
+        if (!validRecordAt(offset))
+        {
+            // left behind by a crashed writer, resynchronize on the next record
+            offset++;
+            continue;
+        }
+        offsets[{header.designHash, header.contextHash}] = offset;
+        offset = end;
+    }
+    indexedSize = offset;
+}
+
+bool PersistentCache::readRecord(size_t offset, Evaluation& result)
+{
+    RecordHeader header;
+    std::memcpy(&header, mapped + offset, sizeof(RecordHeader));
+    result.pathError = header.pathError;
+    result.dofs = header.dofs;
+    result.calculatedPaths.clear();
+    if (header.payloadBytes == 0)
+        return true;
+    const char* data = mapped + offset + sizeof(RecordHeader);
+    result.calculatedPaths.resize(readBytes<uint32_t>(data));
+    for (auto& setPaths : result.calculatedPaths)
+    {
+        setPaths.resize(readBytes<uint32_t>(data));
+        for (auto& path : setPaths)
+        {
+            path.resize(readBytes<uint32_t>(data));
+            for (cpVect& p : path)
+            {
+                p.x = readBytes<double>(data);
+                p.y = readBytes<double>(data);
+            }
+        }
+    }
+    return true;
+}
+
+bool PersistentCache::lookup(uint64_t designHash, uint64_t contextHash, Evaluation& result)
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    if (fd < 0)
+        return false;
+    auto it = offsets.find({designHash, contextHash});
+    if (it == offsets.end())
+    {
+        // other processes may have appended it since the last look
+        refresh();
+        it = offsets.find({designHash, contextHash});
+    }
+    if (it == offsets.end())
+    {
+        misses++;
+        return false;
+    }
+    hits++;
+    return readRecord(it->second, result);
+}
+
+size_t PersistentCache::size()
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    return offsets.size();
+}
+
+void PersistentCache::printStats()
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    std::cout << "Evaluation cache " << filePath << ": " << hits << " hits, " << misses << " misses, " << appended << " appended, " << offsets.size() << " records" << std::endl;
+}
@@ -0,0 +1,50 @@
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "FitnessCache.hpp"
+
+#pragma once
+
+// Append-only evaluation store shared between runs (and processes): (design hash, parameters hash) -> path error,
+// DOFs and optionally the calculated paths. The file is memory mapped for lookups; appends take an exclusive
+// file lock and write whole records, records appended by other processes are picked up on the next miss.
+class PersistentCache {
+    private:
+        struct RecordKey {
+            uint64_t designHash;
+            uint64_t contextHash;
+            bool operator==(const RecordKey& other) const { return designHash == other.designHash && contextHash == other.contextHash; };
+        };
+        struct RecordKeyHash {
+            size_t operator()(const RecordKey& key) const { return key.designHash ^ (key.contextHash * 0x9E3779B97F4A7C15ULL); };
+        };
+        std::string filePath;
+        bool storePaths;
+        int fd = -1;
+        const char* mapped = nullptr;
+        size_t mappedSize = 0;
+        size_t indexedSize = 0;
+        std::unordered_map<RecordKey, size_t, RecordKeyHash> offsets;
+        std::mutex storeMutex;
+        long hits = 0;
+        long misses = 0;
+        long appended = 0;
+        void refresh();
+        void indexRecords();
+        // a whole, uncorrupted record starts at offset
+        bool validRecordAt(size_t offset);
+        bool readRecord(size_t offset, Evaluation& result);
+    public:
+        static uint64_t hash(const std::string& key);
+        // creates the file if needed; storePaths = false only keeps path error and DOFs
+        PersistentCache(std::string filePath, bool storePaths = true);
+        ~PersistentCache();
+        PersistentCache(const PersistentCache&) = delete;
+        PersistentCache& operator=(const PersistentCache&) = delete;
+        bool isOpen() { return fd >= 0; };
+        bool lookup(uint64_t designHash, uint64_t contextHash, Evaluation& result);
+        void append(uint64_t designHash, uint64_t contextHash, const Evaluation& result);
+        size_t size();
+        void printStats();
+};
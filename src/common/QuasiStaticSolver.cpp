@@ -0,0 +1,250 @@
+#define _USE_MATH_DEFINES
+#include "QuasiStaticSolver.hpp"
+#include <cmath>
+
+namespace {
+    // residual weights: links and anchors are rigid in the simulation, targets are held by joint controllers
+    // with a maximum force of 100 (JOINT_MAX_FORCE in MMGrid.cpp), springs use the grid's stiffness
+    const double rigidWeight = 1e6;
+    const double targetWeight = 100;
+    const int maxIterations = 100;
+
+    double wrapAngle(double a)
+    {
+        while (a > M_PI)
+            a -= 2 * M_PI;
+        while (a < -M_PI)
+            a += 2 * M_PI;
+        return a;
+    }
+}
+
+QuasiStaticSolver::QuasiStaticSolver(MMGrid& grid) : rows(grid.getRows()), cols(grid.getCols()), stiffness(grid.getStiffness()),
+    anchors(grid.getAnchors()), targets(grid.getTargets()), targetPaths(grid.getTargetPaths()) {}
+
+void QuasiStaticSolver::setLayout(const vector<int>& cells)
+{
+    bars.clear();
+    springs.clear();
+    for (int r = 0; r <= rows; r++)
+        for (int c = 0; c < cols; c++)
+            bars.push_back({ r * jointCols() + c, r * jointCols() + c + 1, 1 });
+    for (int r = 0; r < rows; r++)
+        for (int c = 0; c <= cols; c++)
+            bars.push_back({ r * jointCols() + c, (r + 1) * jointCols() + c, 1 });
+    // rigid cells get both diagonals
+    for (int i = 0; i < rows * cols; i++)
+    {
+        if (cells[i] != 1)
+            continue;
+        int bl = (i / cols) * jointCols() + i % cols, tl = bl + jointCols();
+        bars.push_back({ bl, tl + 1, M_SQRT2 });
+        bars.push_back({ bl + 1, tl, M_SQRT2 });
+    }
+    // one spring for every row link and column link meeting at a joint
+    for (int j = 0; j < (rows + 1) * jointCols(); j++)
+    {
+        int r = j / jointCols(), c = j % jointCols();
+        vector<std::pair<int, int>> rowLinks, colLinks;
+        if (c > 0)
+            rowLinks.push_back({ j - 1, j });
+        if (c < cols)
+            rowLinks.push_back({ j, j + 1 });
+        if (r > 0)
+            colLinks.push_back({ j - jointCols(), j });
+        if (r < rows)
+            colLinks.push_back({ j, j + jointCols() });
+        for (auto& a : rowLinks)
+            for (auto& b : colLinks)
+                springs.push_back({ a.first, a.second, b.first, b.second });
+    }
+}
+
+// weighted residuals at x (and their jacobian if asked for), returns the cost 0.5 |r|^2
+double QuasiStaticSolver::residuals(const VectorXd& x, const vector<cpVect>& points, VectorXd& r, SparseMatrix<double>* jacobian)
+{
+    int n = bars.size() + 2 * anchors.size() + 2 * targets.size() + springs.size();
+    r.resize(n);
+    vector<Triplet<double>> entries;
+    if (jacobian)
+        entries.reserve(4 * bars.size() + 2 * anchors.size() + 2 * targets.size() + 8 * springs.size());
+    int row = 0;
+    double wRigid = sqrt(rigidWeight), wTarget = sqrt(targetWeight), wSpring = sqrt(stiffness);
+
+    for (Bar& bar : bars)
+    {
+        Vector2d d = x.segment<2>(2 * bar.b) - x.segment<2>(2 * bar.a);
+        double len = std::max(d.norm(), 1e-12);
+        r[row] = wRigid * (len - bar.length);
+        if (jacobian)
+            for (int k = 0; k < 2; k++)
+            {
+                entries.push_back(Triplet<double>(row, 2 * bar.b + k, wRigid * d[k] / len));
+                entries.push_back(Triplet<double>(row, 2 * bar.a + k, -wRigid * d[k] / len));
+            }
+        row++;
+    }
+    for (int a : anchors)
+    {
+        cpVect rest = restPosition(a);
+        r[row] = wRigid * (x[2 * a] - rest.x);
+        r[row + 1] = wRigid * (x[2 * a + 1] - rest.y);
+        if (jacobian)
+        {
+            entries.push_back(Triplet<double>(row, 2 * a, wRigid));
+            entries.push_back(Triplet<double>(row + 1, 2 * a + 1, wRigid));
+        }
+        row += 2;
+    }
+    for (int t = 0; t < targets.size(); t++)
+    {
+        int j = targets[t];
+        r[row] = wTarget * (x[2 * j] - points[t].x);
+        r[row + 1] = wTarget * (x[2 * j + 1] - points[t].y);
+        if (jacobian)
+        {
+            entries.push_back(Triplet<double>(row, 2 * j, wTarget));
+            entries.push_back(Triplet<double>(row + 1, 2 * j + 1, wTarget));
+        }
+        row += 2;
+    }
+    for (Spring& spring : springs)
+    {
+        // rotation of each link away from its rest direction (row links point along x, column links along y)
+        Vector2d da = x.segment<2>(2 * spring.a1) - x.segment<2>(2 * spring.a0);
+        Vector2d db = x.segment<2>(2 * spring.b1) - x.segment<2>(2 * spring.b0);
+        double angleA = atan2(da.y(), da.x()), angleB = atan2(db.y(), db.x()) - M_PI_2;
+        r[row] = wSpring * wrapAngle(angleA - angleB);
+        if (jacobian)
+        {
+            Vector2d ga = Vector2d(-da.y(), da.x()) / std::max(da.squaredNorm(), 1e-12);
+            Vector2d gb = Vector2d(-db.y(), db.x()) / std::max(db.squaredNorm(), 1e-12);
+            for (int k = 0; k < 2; k++)
+            {
+                entries.push_back(Triplet<double>(row, 2 * spring.a1 + k, wSpring * ga[k]));
+                entries.push_back(Triplet<double>(row, 2 * spring.a0 + k, -wSpring * ga[k]));
+                entries.push_back(Triplet<double>(row, 2 * spring.b1 + k, -wSpring * gb[k]));
+                entries.push_back(Triplet<double>(row, 2 * spring.b0 + k, wSpring * gb[k]));
+            }
+        }
+        row++;
+    }
+    if (jacobian)
+    {
+        jacobian->resize(n, x.size());
+        jacobian->setFromTriplets(entries.begin(), entries.end());
+    }
+    return 0.5 * r.squaredNorm();
+}
+
+// Levenberg-Marquardt: Gauss-Newton steps, damped more whenever a step doesn't lower the cost
+void QuasiStaticSolver::solve(const vector<cpVect>& points)
+{
+    VectorXd r, rNew;
+    SparseMatrix<double> J;
+    double cost = residuals(x, points, r, &J);
+    double lambda = 1e-3;
+    SimplicialLDLT<SparseMatrix<double>> ldlt;
+    bool analyzed = false;
+    for (int it = 0; it < maxIterations; it++)
+    {
+        lastIterations++;
+        SparseMatrix<double> H = J.transpose() * J;
+        VectorXd g = J.transpose() * r;
+        if (g.lpNorm<Infinity>() < 1e-9)
+            break;
+        bool improved = false;
+        double step = 0, decrease = 0;
+        for (int attempt = 0; attempt < 30 && !improved; attempt++)
+        {
+            SparseMatrix<double> A = H;
+            // plain (not diagonally scaled) damping, scaling by the diagonal would mostly damp the soft spring modes
+            for (int k = 0; k < A.rows(); k++)
+                A.coeffRef(k, k) += lambda;
+            if (!analyzed)
+            {
+                ldlt.analyzePattern(A);
+                analyzed = true;
+            }
+            ldlt.factorize(A);
+            lastFactorizations++;
+            if (ldlt.info() != Success)
+            {
+                lambda *= 10;
+                continue;
+            }
+            VectorXd delta = ldlt.solve(g);
+            VectorXd xNew = x - delta;
+            double costNew = residuals(xNew, points, rNew, nullptr);
+            // chord corrections with the same factorization pull the step back into the curved valley
+            for (int c = 0; c < 3; c++)
+            {
+                VectorXd correction = ldlt.solve(J.transpose() * rNew);
+                VectorXd xCorr = xNew - correction;
+                VectorXd rCorr;
+                double costCorr = residuals(xCorr, points, rCorr, nullptr);
+                if (costCorr >= costNew)
+                    break;
+                xNew = xCorr;
+                rNew = rCorr;
+                costNew = costCorr;
+                delta += correction;
+            }
+            if (costNew < cost)
+            {
+                improved = true;
+                step = delta.lpNorm<Infinity>();
+                decrease = cost - costNew;
+                x = xNew;
+                lambda = std::max(lambda / 3, 1e-12);
+            }
+            else
+                lambda *= 10;
+        }
+        if (!improved)
+            break;
+        cost = residuals(x, points, r, &J);
+        if (step < 1e-7 || decrease < 1e-10 * (1 + cost))
+            break;
+    }
+}
+
+double QuasiStaticSolver::getPathError(const vector<int>& cells, double budget)
+{
+    lastIterations = 0;
+    lastFactorizations = 0;
+    calculatedPaths.assign(targets.size(), {});
+    if (targetPaths.empty())
+        return 0;
+    setLayout(cells);
+    int numJoints = (rows + 1) * jointCols();
+    x.resize(2 * numJoints);
+    for (int j = 0; j < numJoints; j++)
+    {
+        cpVect rest = restPosition(j);
+        x[2 * j] = rest.x;
+        x[2 * j + 1] = rest.y;
+    }
+    // like getPathError: step 0 counts INT8_MAX, step s reports the equilibrium at path point s - 1
+    double totError = 0;
+    for (int pathStep = 0; pathStep < targetPaths[0].size(); pathStep++)
+    {
+        double curError = INT8_MAX;
+        if (pathStep > 0)
+        {
+            vector<cpVect> points;
+            for (auto& path : targetPaths)
+                points.push_back(path[pathStep - 1]);
+            solve(points);
+            curError = 0;
+            for (int t = 0; t < targets.size(); t++)
+                curError += cpvdistsq(position(targets[t]), points[t]);
+        }
+        for (int t = 0; t < targets.size(); t++)
+            calculatedPaths[t].push_back(position(targets[t]));
+        totError += curError;
+        if (totError > budget)
+            return totError;
+    }
+    return totError;
+}
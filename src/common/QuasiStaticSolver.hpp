@@ -0,0 +1,47 @@
+#include <Eigen/Sparse>
+#include "MMGrid.hpp"
+
+#pragma once
+
+// Quasi-static alternative to MMGrid::getPathError: instead of stepping the dynamics until they settle, every path
+// point's equilibrium is solved for directly. The unknowns are the joint positions; links (and the diagonals of
+// rigid cells) keep their length, anchored joints their rest position, target joints are pulled towards the path
+// point as hard as the joint controllers can, and the rotary springs between neighbouring links resist rotation.
+// Damped Gauss-Newton on the weighted residuals, one sparse LDLT per iteration, each point starting from the last.
+// Errors and calculated paths are accounted exactly like getPathError, so the two can be swapped and compared.
+class QuasiStaticSolver {
+    private:
+        struct Bar {
+            int a, b;
+            double length;
+        };
+        // rotary spring between the row link a0-a1 and the column link b0-b1
+        struct Spring {
+            int a0, a1, b0, b1;
+        };
+        int rows;
+        int cols;
+        double stiffness;
+        vector<int> anchors;
+        vector<int> targets;
+        vector<vector<cpVect>> targetPaths;
+        vector<Bar> bars;
+        vector<Spring> springs;
+        VectorXd x;
+        vector<vector<cpVect>> calculatedPaths;
+        long lastIterations = 0;
+        long lastFactorizations = 0;
+        int jointCols() { return cols + 1; };
+        cpVect restPosition(int jointIndex) { return cpv(jointIndex % jointCols(), jointIndex / jointCols()); };
+        cpVect position(int jointIndex) { return cpv(x[2 * jointIndex], x[2 * jointIndex + 1]); };
+        void setLayout(const vector<int>& cells);
+        double residuals(const VectorXd& x, const vector<cpVect>& points, VectorXd& r, SparseMatrix<double>* jacobian);
+        void solve(const vector<cpVect>& points);
+    public:
+        QuasiStaticSolver(MMGrid& grid);
+        double getPathError(const vector<int>& cells, double budget = DBL_MAX);
+        vector<vector<cpVect>> getCalculatedPaths() { return calculatedPaths; };
+        // Gauss-Newton iterations and matrix factorizations of the last getPathError
+        long getLastIterations() { return lastIterations; };
+        long getLastFactorizations() { return lastFactorizations; };
+};
@@ -0,0 +1,246 @@
+#include "RemoteEvaluator.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const int maxAttempts = 3;
+}
+
+RemoteEvaluator::RemoteEvaluator(std::vector<std::string> endpoints, int timeoutMs, int batchSize) : timeoutMs(timeoutMs), batchSize(std::max(1, batchSize))
+{
+    for (std::string& endpoint : endpoints)
+    {
+        size_t colon = endpoint.find_last_of(':');
+        if (colon == std::string::npos)
+        {
+            std::cout << "worker " << endpoint << " is not of the form host:port, ignored" << std::endl;
+            continue;
+        }
+        Connection connection;
+        connection.host = endpoint.substr(0, colon);
+        connection.port = endpoint.substr(colon + 1);
+        connections.push_back(connection);
+    }
+    for (Connection& connection : connections)
+        connect(connection);
+    std::cout << "Connected to " << numConnected() << " of " << connections.size() << " workers" << std::endl;
+}
+
+RemoteEvaluator::~RemoteEvaluator()
+{
+    for (Connection& connection : connections)
+        disconnect(connection);
+}
+
+int RemoteEvaluator::numConnected()
+{
+    return std::count_if(connections.begin(), connections.end(), [](const Connection& c) { return c.fd >= 0; });
+}
+
+void RemoteEvaluator::printStats()
+{
+    std::cout << "Workers: " << dispatched << " jobs dispatched, " << resubmitted << " resubmitted, " << failed << " simulated locally" << std::endl;
+}
+
+#ifndef _WIN32
+
+bool RemoteEvaluator::connect(Connection& connection)
+{
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses;
+    if (getaddrinfo(connection.host.c_str(), connection.port.c_str(), &hints, &addresses) != 0)
+        return false;
+    for (addrinfo* a = addresses; a; a = a->ai_next)
+    {
+        int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (::connect(fd, a->ai_addr, a->ai_addrlen) == 0)
+        {
+            // requests are small and latency bound
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            connection.fd = fd;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(addresses);
+    return connection.fd >= 0;
+}
+
+void RemoteEvaluator::disconnect(Connection& connection)
+{
+    if (connection.fd >= 0)
+        close(connection.fd);
+    connection.fd = -1;
+    connection.received.clear();
+}
+
+void RemoteEvaluator::run(std::vector<WorkerProtocol::Request>& requests, std::vector<WorkerProtocol::Reply>& replies, std::vector<bool>& done)
+{
+    replies.assign(requests.size(), WorkerProtocol::Reply());
+    done.assign(requests.size(), false);
+    for (Connection& connection : connections)
+    {
+        if (connection.fd < 0)
+            connect(connection);
+    }
+
+    std::unordered_map<uint64_t, size_t> jobs;
+    std::deque<size_t> queue;
+    std::vector<int> attempts(requests.size(), 0);
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        requests[i].jobId = nextJobId++;
+        jobs[requests[i].jobId] = i;
+        queue.push_back(i);
+    }
+
+    // a lost connection hands its jobs back to the queue, unless they have been tried often enough
+    auto drop = [&](Connection& connection) {
+        std::cout << "lost worker " << connection.host << ":" << connection.port << std::endl;
+        disconnect(connection);
+        for (size_t i : connection.inFlight)
+        {
+            if (attempts[i] < maxAttempts)
+            {
+                queue.push_front(i);
+                resubmitted++;
+            }
+            else
+                failed++;
+        }
+        connection.inFlight.clear();
+    };
+
+    auto busy = [&]() {
+        return !queue.empty() || std::any_of(connections.begin(), connections.end(), [](const Connection& c) { return !c.inFlight.empty(); });
+    };
+    while (busy())
+    {
+        // top up every connection in a single write
+        for (Connection& connection : connections)
+        {
+            if (connection.fd < 0 || queue.empty() || connection.inFlight.size() >= batchSize)
+                continue;
+            std::string buffer;
+            if (connection.inFlight.empty())
+                connection.lastActivity = std::chrono::steady_clock::now();
+            while (!queue.empty() && connection.inFlight.size() < batchSize)
+            {
+                size_t i = queue.front();
+                queue.pop_front();
+                attempts[i]++;
+                dispatched++;
+                connection.inFlight.push_back(i);
+                WorkerProtocol::encodeRequest(requests[i], buffer);
+            }
+            if (!WorkerProtocol::sendAll(connection.fd, buffer))
+                drop(connection);
+        }
+
+        std::vector<pollfd> fds;
+        std::vector<Connection*> polled;
+        auto now = std::chrono::steady_clock::now();
+        int wait = timeoutMs;
+        for (Connection& connection : connections)
+        {
+            if (connection.fd < 0 || connection.inFlight.empty())
+                continue;
+            fds.push_back({ connection.fd, POLLIN, 0 });
+            polled.push_back(&connection);
+            int elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - connection.lastActivity).count();
+            wait = std::min(wait, std::max(0, timeoutMs - elapsed));
+        }
+        if (fds.empty())
+        {
+            // no worker left, whatever is queued is simulated locally
+            failed += queue.size();
+            queue.clear();
+            break;
+        }
+        if (poll(fds.data(), fds.size(), wait) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            for (Connection* connection : polled)
+                drop(*connection);
+            continue;
+        }
+
+        now = std::chrono::steady_clock::now();
+        for (size_t p = 0; p < fds.size(); p++)
+        {
+            Connection& connection = *polled[p];
+            if (fds[p].revents == 0)
+            {
+                if (std::chrono::duration_cast<std::chrono::milliseconds>(now - connection.lastActivity).count() >= timeoutMs)
+                    drop(connection);
+                continue;
+            }
+            char chunk[65536];
+            ssize_t n = recv(connection.fd, chunk, sizeof(chunk), 0);
+            if (n <= 0)
+            {
+                drop(connection);
+                continue;
+            }
+            connection.lastActivity = now;
+            connection.received.append(chunk, n);
+            // complete frames only, the rest stays buffered
+            size_t offset = 0;
+            uint32_t size;
+            while (connection.received.size() - offset >= sizeof(size))
+            {
+                std::memcpy(&size, connection.received.data() + offset, sizeof(size));
+                if (connection.received.size() - offset - sizeof(size) < size)
+                    break;
+                WorkerProtocol::Reply reply;
+                bool valid = WorkerProtocol::decodeReply(connection.received.substr(offset + sizeof(size), size), reply);
+                offset += sizeof(size) + size;
+                auto job = jobs.find(reply.jobId);
+                if (!valid || job == jobs.end())
+                    continue;
+                size_t i = job->second;
+                auto it = std::find(connection.inFlight.begin(), connection.inFlight.end(), i);
+                if (it != connection.inFlight.end())
+                    connection.inFlight.erase(it);
+                replies[i] = reply;
+                done[i] = true;
+            }
+            connection.received.erase(0, offset);
+        }
+    }
+}
+
+#else
+
+bool RemoteEvaluator::connect(Connection& connection)
+{
+    std::cout << "remote workers are not supported on this platform" << std::endl;
+    return false;
+}
+
+void RemoteEvaluator::disconnect(Connection& connection) {}
+
+void RemoteEvaluator::run(std::vector<WorkerProtocol::Request>& requests, std::vector<WorkerProtocol::Reply>& replies, std::vector<bool>& done)
+{
+    replies.assign(requests.size(), WorkerProtocol::Reply());
+    done.assign(requests.size(), false);
+}
+
+#endif
@@ -0,0 +1,43 @@
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+#include "WorkerProtocol.hpp"
+
+#pragma once
+
+// Sends path set simulations to dynamic_mm_worker processes (see WorkerProtocol.hpp) and collects the replies.
+// Each endpoint is one connection served by one worker thread, so list an endpoint several times to use several
+// cores of that worker. Up to batchSize jobs are in flight per connection; a connection that fails or stays silent
+// for longer than the timeout is dropped and its jobs go to the other workers (each job is tried at most 3 times).
+class RemoteEvaluator {
+    private:
+        struct Connection {
+            std::string host;
+            std::string port;
+            int fd = -1;
+            std::deque<size_t> inFlight;
+            std::string received;
+            std::chrono::steady_clock::time_point lastActivity;
+        };
+        std::vector<Connection> connections;
+        int timeoutMs;
+        int batchSize;
+        uint64_t nextJobId = 1;
+        long dispatched = 0;
+        long resubmitted = 0;
+        long failed = 0;
+        bool connect(Connection& connection);
+        void disconnect(Connection& connection);
+    public:
+        // endpoints as "host:port"
+        RemoteEvaluator(std::vector<std::string> endpoints, int timeoutMs = 30000, int batchSize = 2);
+        ~RemoteEvaluator();
+        RemoteEvaluator(const RemoteEvaluator&) = delete;
+        RemoteEvaluator& operator=(const RemoteEvaluator&) = delete;
+        // dropped connections are retried at the start of every run; replies[i] answers requests[i] where done[i],
+        // jobs no worker could finish are left for the caller to simulate locally
+        void run(std::vector<WorkerProtocol::Request>& requests, std::vector<WorkerProtocol::Reply>& replies, std::vector<bool>& done);
+        int numConnected();
+        void printStats();
+};
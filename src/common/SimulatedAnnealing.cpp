@@ -1,20 +1,9 @@
 #include "SimulatedAnnealing.hpp"
-
-MMGrid mutate(MMGrid start) {
-    ConstraintGraph cg(start.getRows(), start.getCols(), start.getCells());
-    if(rand() % 2 == 0 && cg.dofs() > 1) {
-        cg.mergeComponents();
-    }
-    else if(cg.dofs() == start.getRows() + start.getCols()){
-        cg.mergeComponents();
-    }
-    else {
-        cg.splitComponents();
-    }
-    MMGrid result(start);
-    result.setCells(start.getRows(), start.getRows(), cg.makeCells());
-    return result;
-}
+#include <cmath>
+#include <ctime>
+#include "PRand.hpp"
+#include <memory>
+#include "CandidateEvaluator.hpp"
 
 
 SimulatedAnnealing::SimulatedAnnealing(string configfile) : simGrid(2, 2, std::vector<int>(4)){
@@ -25,37 +14,59 @@ SimulatedAnnealing::SimulatedAnnealing(string configfile) : simGrid(2, 2, std::v
 SimulatedAnnealing::SimulatedAnnealing(MMGrid startGrid, double pathWeight, double dofWeight) : simGrid(startGrid), pathWeight(pathWeight), dofWeight(dofWeight) {}
 
 MMGrid SimulatedAnnealing::simulate(int numIterations, double coolingFactor) {
-    srand(time(NULL));
+    seedRandom(time(NULL));
+    std::vector<MMGrid> pathSets;
+    pathSets.emplace_back(simGrid);
+    // a single path set, the evaluator's threads go to the candidates instead
+    int threads = 1;
+    if(numCandidates > 1) {
+        threads = numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+    }
+    CandidateEvaluator evaluator(pathSets, pathWeight, dofWeight, threads);
+    FitnessCache runCache;
+    FitnessCache* fitnessCache = cache ? cache : &runCache;
+    evaluator.setCache(fitnessCache);
+    evaluator.setPersistentCache(store);
+    int rows = simGrid.getRows(), cols = simGrid.getCols();
+    vector<int> cells = simGrid.getCells();
     double startingTemp = numIterations / 3.0;
-    double prevErr;
-    double pathErr = simGrid.getPathError();
-    ConstraintGraph cg(simGrid.getRows(), simGrid.getCols(), simGrid.getCells());
-    double dofErr = cg.dofs();
-    prevErr = pathErr * pathWeight + dofErr * dofWeight;
+    double prevErr = evaluator.evaluate(cells).error;
     for(int i = 0; i < numIterations; i++) {
         std::cout << "Iteration: " << i << endl;
         std::cout << "Previous weighted error is " << prevErr << std::endl;
         double acceptThresh = 1.0 / (1.0 + exp(prevErr / (startingTemp * pow(coolingFactor, i))));
+        // draw the acceptance up front: unless a worse candidate would be accepted anyway,
+        // only candidates below prevErr matter and the others can be cut short
+        bool acceptAny = randomUniform() < acceptThresh;
+        double budget = acceptAny ? DBL_MAX : prevErr;
 
-        MMGrid candGrid = mutate(simGrid);
-        pathErr = candGrid.getPathError();
-        ConstraintGraph cg2(candGrid.getRows(), candGrid.getCols(), candGrid.getCells());
-        dofErr = cg2.dofs();
-        double newErr = pathErr * pathWeight + dofErr * dofWeight;
-        std::cout << "New weighted error is " << newErr << std::endl;
-        if(newErr < prevErr) {
-            simGrid.setCells(candGrid.getRows(), candGrid.getCols(), candGrid.getCells());
-            prevErr = newErr;
+        // candidates are mutated here (the random engine is per thread) and simulated together by the evaluator
+        std::vector<vector<int>> candCells(numCandidates);
+        for(int k = 0; k < numCandidates; k++) {
+            ConstraintGraph candCg(rows, cols, cells);
+            candCg.mutate();
+            candCells[k] = candCg.makeCells();
         }
-        else if((double)rand() / (double)RAND_MAX < acceptThresh) {
-            simGrid.setCells(candGrid.getRows(), candGrid.getCols(), candGrid.getCells());
-            prevErr = newErr;
+        std::vector<Evaluation> evaluations = evaluator.evaluateBatch(candCells, budget);
+        std::vector<double> candErrs(numCandidates);
+        for(int k = 0; k < numCandidates; k++) {
+            candErrs[k] = evaluations[k].error;
         }
-        else {
-            simGrid.setCells(simGrid.getRows(), simGrid.getCols(), simGrid.getCells());
+
+        int bestCand = std::min_element(candErrs.begin(), candErrs.end()) - candErrs.begin();
+        double newErr = candErrs[bestCand];
+        std::cout << "New weighted error is " << newErr << std::endl;
+        if(newErr < prevErr || acceptAny) {
+            cells = candCells[bestCand];
+            prevErr = newErr;
         }
         
     }
+    std::cout << "Stopped " << evaluator.getAborted() << " of " << evaluator.getEvaluated() << " simulations early" << std::endl;
+    std::cout << "Prescreen avoided " << evaluator.getPrescreened() << " simulations" << std::endl;
+    fitnessCache->printStats();
+    if (store)
+        store->printStats();
+    simGrid.setCells(rows, cols, cells);
     return simGrid;
 }
-
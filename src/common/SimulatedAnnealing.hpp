@@ -1,12 +1,29 @@
+#include <algorithm>
 #include "MMGrid.hpp"
+#include "FitnessCache.hpp"
+#include "PersistentCache.hpp"
 
 class SimulatedAnnealing {
     private:
         MMGrid simGrid;
         double pathWeight;
         double dofWeight;
+        int numCandidates = 1;
+        int numThreads = 0;
+        FitnessCache* cache = nullptr;
+        PersistentCache* store = nullptr;
     public:
         SimulatedAnnealing(string configfile);
         SimulatedAnnealing(MMGrid startGrid, double dofWeight, double pathWeight);
+        // generate numCandidates mutations per iteration and evaluate them on numThreads threads (0 = all cores);
+        // the best candidate then goes through the usual acceptance test
+        void setParallelCandidates(int numCandidates, int numThreads = 0) {
+            this->numCandidates = std::max(1, numCandidates);
+            this->numThreads = numThreads;
+        };
+        // evaluations are memoized in cache (kept across runs); without one, each run uses its own
+        void setCache(FitnessCache* cache) { this->cache = cache; };
+        // on-disk evaluation store shared with other runs and processes
+        void setPersistentCache(PersistentCache* store) { this->store = store; };
         MMGrid simulate(int numIterations, double coolingFactor = 0.05);
-};
\ No newline at end of file
+};
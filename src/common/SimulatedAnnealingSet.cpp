@@ -1,72 +1,261 @@
 #include "SimulatedAnnealingSet.hpp"
-#include "UIModelData.hpp"
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "PRand.hpp"
+#include "CandidateEvaluator.hpp"
 
-namespace SimulatedAnnealingNS {
+    SimulatedAnnealingSet::SimulatedAnnealingSet(std::vector<MMGrid> startGrids, double dofWeight, double pathWeight) : simGrids(startGrids), pathWeight(pathWeight), dofWeight(dofWeight) {}
 
-    MMGrid mutate(MMGrid start) {
-        ConstraintGraph cg(start.getRows(), start.getCols(), start.getCells());
-        if (rand() % 2 == 0 && cg.dofs() > 1) {
-            cg.mergeComponents();
-        }
-        else if (cg.dofs() == start.getRows() + start.getCols()) {
-            cg.mergeComponents();
-        }
-        else {
-            cg.splitComponents();
+    void SimulatedAnnealingSet::setCheckpoint(std::string filePath, int every) {
+        checkpointPath = filePath;
+        checkpointEvery = every;
+    }
+
+    std::string SimulatedAnnealingSet::serializeState() {
+        int rows = simGrids[0].getRows(), cols = simGrids[0].getCols();
+        std::ostringstream out;
+        out << std::setprecision(17);
+        out << "#checkpoint" << std::endl;
+        out << "context " << PersistentCache::hash(CandidateEvaluator::solverContextKey(simGrids, quasiStatic, warmStarting())) << std::endl;
+        out << "weights " << pathWeight << " " << dofWeight << std::endl;
+        out << "iteration " << iteration << std::endl;
+        out << "schedule " << startingTemp << " " << coolingFactor << std::endl;
+        out << "temperature " << startingTemp * pow(coolingFactor, iteration) << std::endl;
+        out << "grid " << rows << " " << cols << std::endl;
+        out << "cells";
+        for (int c : cells)
+            out << " " << c;
+        out << std::endl;
+        out << "constraints";
+        for (int c : ConstraintGraph(rows, cols, cells).canonicalConstraints())
+            out << " " << c;
+        out << std::endl;
+        out << "error " << prevErr << std::endl;
+        out << "bestCells";
+        for (int c : bestCells)
+            out << " " << c;
+        out << std::endl;
+        out << "bestError " << bestErr << std::endl;
+        out << "history " << errorHistory.size();
+        for (double e : errorHistory)
+            out << " " << e;
+        out << std::endl;
+        out << "random " << randomEngine() << std::endl;
+        out << "paths " << calculatedPaths.size() << std::endl;
+        for (auto& setPaths : calculatedPaths)
+        {
+            out << setPaths.size() << std::endl;
+            for (auto& path : setPaths)
+            {
+                out << path.size();
+                for (cpVect p : path)
+                    out << " " << p.x << " " << p.y;
+                out << std::endl;
+            }
         }
-        MMGrid result(start);
-        result.setCells(start.getRows(), start.getRows(), cg.makeCells());
-        return result;
+        return out.str();
     }
-}
 
+    void SimulatedAnnealingSet::writeCheckpoint() {
+        if (checkpointPath.empty())
+            return;
+        // at most one write in flight, the state is serialized here so the annealing can go on meanwhile
+        if (pendingCheckpoint.valid())
+            pendingCheckpoint.get();
+        std::string state = serializeState();
+        std::string filePath = checkpointPath;
+        pendingCheckpoint = std::async(std::launch::async, [state, filePath]() {
+            std::string tmpPath = filePath + ".tmp";
+            ofstream file(tmpPath, std::ios::binary);
+            file << state;
+            file.close();
+            if (!file.good() || std::rename(tmpPath.c_str(), filePath.c_str()) != 0)
+                std::cout << "could not write checkpoint " << filePath << std::endl;
+        });
+    }
 
-    SimulatedAnnealingSet::SimulatedAnnealingSet(std::vector<MMGrid> startGrids, double dofWeight, double pathWeight) : simGrids(startGrids), pathWeight(pathWeight), dofWeight(dofWeight) {}
+    bool SimulatedAnnealingSet::resume(std::string filePath) {
+        ifstream file(filePath);
+        if (!file.good())
+        {
+            std::cout << "checkpoint " << filePath << " not found!" << std::endl;
+            return false;
+        }
+        int rows = simGrids[0].getRows(), cols = simGrids[0].getCols();
+        uint64_t context = 0;
+        int fileRows = 0, fileCols = 0;
+        double filePathWeight = NAN, fileDofWeight = NAN;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream in(line);
+            std::string field;
+            // the paths block is read past its lines, which leaves an empty one behind
+            if (!(in >> field))
+                continue;
+            if (field == "context") in >> context;
+            else if (field == "weights") in >> filePathWeight >> fileDofWeight;
+            else if (field == "iteration") in >> iteration;
+            else if (field == "schedule") in >> startingTemp >> coolingFactor;
+            else if (field == "grid") in >> fileRows >> fileCols;
+            else if (field == "error") in >> prevErr;
+            else if (field == "bestError") in >> bestErr;
+            else if (field == "random") in >> engine;
+            else if (field == "cells" || field == "bestCells")
+            {
+                vector<int>& target = field == "cells" ? cells : bestCells;
+                target.clear();
+                int c;
+                while (in >> c)
+                    target.push_back(c);
+            }
+            else if (field == "history")
+            {
+                int n = 0;
+                in >> n;
+                errorHistory.resize(n);
+                for (double& e : errorHistory)
+                    in >> e;
+            }
+            else if (field == "paths")
+            {
+                int numSets = 0;
+                in >> numSets;
+                calculatedPaths.assign(numSets, {});
+                for (auto& setPaths : calculatedPaths)
+                {
+                    int numPaths = 0;
+                    file >> numPaths;
+                    setPaths.resize(numPaths);
+                    for (auto& path : setPaths)
+                    {
+                        int numPoints = 0;
+                        file >> numPoints;
+                        path.resize(numPoints);
+                        for (cpVect& p : path)
+                            file >> p.x >> p.y;
+                    }
+                }
+            }
+        }
+        if (context != PersistentCache::hash(CandidateEvaluator::solverContextKey(simGrids, quasiStatic, warmStarting())) || fileRows != rows || fileCols != cols
+            || cells.size() != rows * cols || bestCells.size() != rows * cols)
+        {
+            std::cout << "checkpoint " << filePath << " does not belong to these path sets" << std::endl;
+            iteration = 0;
+            return false;
+        }
+        // the errors in the checkpoint were weighted with these
+        if (filePathWeight != pathWeight || fileDofWeight != dofWeight)
+        {
+            std::cout << "checkpoint " << filePath << " was written with path weight " << filePathWeight << " and dof weight "
+                << fileDofWeight << ", not " << pathWeight << " and " << dofWeight << std::endl;
+            iteration = 0;
+            return false;
+        }
+        resumed = true;
+        std::cout << "Resuming from iteration " << iteration << " with weighted error " << prevErr << " (best " << bestErr << ")" << std::endl;
+        return true;
+    }
 
     MMGrid SimulatedAnnealingSet::simulate(int numIterations, double coolingFactor) {
-        srand(time(NULL));
-        double startingTemp = numIterations / 3.0;
-        double prevErr;
-        double pathErr = 0;
-        for (auto simGrid : simGrids) {
-            pathErr += simGrid.getPathError();
+        seedRandom(time(NULL));
+        // by default one thread per path set of every candidate simulated together
+        int threads = numThreads;
+        if (threads <= 0 && candidatesPerIteration > 1)
+            threads = std::min<int>(candidatesPerIteration * simGrids.size(), std::max(1u, std::thread::hardware_concurrency()));
+        CandidateEvaluator evaluator(simGrids, pathWeight, dofWeight, threads);
+        FitnessCache runCache;
+        FitnessCache* fitnessCache = cache ? cache : &runCache;
+        evaluator.setQuasiStatic(quasiStatic);
+        evaluator.setCache(fitnessCache);
+        evaluator.setPersistentCache(store);
+        evaluator.setRemote(remote);
+        evaluator.setWarmStart(warmStarting());
+        int rows = simGrids[0].getRows(), cols = simGrids[0].getCols();
+        if (resumed) {
+            // the schedule and random stream continue exactly as they were when the checkpoint was taken
+            randomEngine() = engine;
+            resumed = false;
+            // the current layout's poses seed the next candidates, as after any other iteration
+            evaluator.reseed(cells);
+        }
+        else {
+            iteration = 0;
+            startingTemp = numIterations / 3.0;
+            this->coolingFactor = coolingFactor;
+            cells = simGrids[0].getCells();
+            Evaluation start = evaluator.evaluate(cells);
+            evaluator.accept(cells);
+            prevErr = start.error;
+            bestErr = prevErr;
+            bestCells = cells;
+            calculatedPaths = start.calculatedPaths;
+            errorHistory.clear();
         }
-        ConstraintGraph cg(simGrids[0].getRows(), simGrids[0].getCols(), simGrids[0].getCells());
-        double dofErr = cg.dofs();
-        prevErr = pathErr * pathWeight + dofErr * dofWeight;
-        for (int i = 0; i < numIterations; i++) {
+        for (; iteration < numIterations; iteration++) {
+            if (cancelFlag && *cancelFlag) {
+                std::cout << "Cancelled at iteration " << iteration << std::endl;
+                break;
+            }
+            if (checkpointEvery > 0 && iteration % checkpointEvery == 0)
+                writeCheckpoint();
+            int i = iteration;
             std::cout << "Iteration: " << i << endl;
             std::cout << "Previous weighted error is " << prevErr << std::endl;
-            double acceptThresh = 1.0 / (1.0 + exp(prevErr / (startingTemp * pow(coolingFactor, i))));
+            errorHistory.push_back(prevErr);
+            double acceptThresh = 1.0 / (1.0 + exp(prevErr / (startingTemp * pow(this->coolingFactor, i))));
+            // unless a worse candidate would be accepted anyway, stop simulating once it can't beat prevErr
+            bool acceptAny = randomUniform() < acceptThresh;
 
-            MMGrid candGrid = SimulatedAnnealingNS::mutate(simGrids[0]);
-            pathErr = 0;
-            int calcPathIndex = 0;
-            for (auto simGrid : simGrids) {
-                MMGrid tmp(simGrid);
-                tmp.setCells(candGrid.getRows(), candGrid.getCols(), candGrid.getCells());
-                pathErr += tmp.getPathError();
-                UIModelData::allCalculatedPaths[calcPathIndex] = tmp.getCalculatedPaths();
-                calcPathIndex++;
+            std::vector<vector<int>> candidates;
+            for (int k = 0; k < candidatesPerIteration; k++) {
+                ConstraintGraph cg(rows, cols, cells);
+                cg.mutate();
+                candidates.push_back(cg.makeCells());
+            }
+            std::vector<Evaluation> evaluations = evaluator.evaluateBatch(candidates, acceptAny ? DBL_MAX : prevErr);
+            int c = 0;
+            for (int k = 1; k < evaluations.size(); k++) {
+                if (evaluations[k].error < evaluations[c].error)
+                    c = k;
             }
-            ConstraintGraph cg2(candGrid.getRows(), candGrid.getCols(), candGrid.getCells());
-            dofErr = cg2.dofs();
-            double newErr = pathErr * pathWeight + dofErr * dofWeight;
+            vector<int> candCells = candidates[c];
+            Evaluation& cand = evaluations[c];
+            double newErr = cand.error;
             std::cout << "New weighted error is " << newErr << std::endl;
-            if (newErr < prevErr) {
-                simGrids[0].setCells(candGrid.getRows(), candGrid.getCols(), candGrid.getCells());
-                prevErr = newErr;
+            bool improved = newErr < bestErr;
+            if (improved) {
+                bestErr = newErr;
+                bestCells = candCells;
+                calculatedPaths = cand.calculatedPaths;
             }
-            else if ((double)rand() / (double)RAND_MAX < acceptThresh) {
-                simGrids[0].setCells(candGrid.getRows(), candGrid.getCols(), candGrid.getCells());
+            if (newErr < prevErr || acceptAny) {
+                cells = candCells;
                 prevErr = newErr;
             }
-            else {
-                simGrids[0].setCells(simGrids[0].getRows(), simGrids[0].getCols(), simGrids[0].getCells());
-            }
+            evaluator.accept(cells);
+            if (progressCallback)
+                progressCallback(iteration + 1, numIterations, improved);
         }
-        
-        cout << "all calc paths size" << endl;
-        cout << UIModelData::allCalculatedPaths.size() << endl;
+        writeCheckpoint();
+        if (pendingCheckpoint.valid())
+            pendingCheckpoint.get();
+
+        std::cout << "Stopped " << evaluator.getAborted() << " of " << evaluator.getEvaluated() << " simulations early" << std::endl;
+        std::cout << "Prescreen avoided " << evaluator.getPrescreened() << " simulations" << std::endl;
+        evaluator.printWarmStartStats();
+        evaluator.printConvergenceStats();
+        fitnessCache->printStats();
+        if (store)
+            store->printStats();
+        if (remote)
+            remote->printStats();
+        std::cout << "Best weighted error is " << bestErr << std::endl;
+        simGrids[0].setCells(rows, cols, bestCells);
         return simGrids[0];
-    }
\ No newline at end of file
+    }
@@ -1,11 +1,83 @@
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <random>
 #include "MMGrid.hpp"
+#include "FitnessCache.hpp"
+#include "PersistentCache.hpp"
+#include "RemoteEvaluator.hpp"
+
+#pragma once
 
 class SimulatedAnnealingSet {
     private:
         std::vector<MMGrid> simGrids;
         double pathWeight;
         double dofWeight;
+        int numThreads = 0;
+        FitnessCache* cache = nullptr;
+        PersistentCache* store = nullptr;
+        RemoteEvaluator* remote = nullptr;
+        int candidatesPerIteration = 1;
+        bool warmStart = false;
+        bool quasiStatic = false;
+        double bestErr;
+        vector<vector<vector<cpVect>>> calculatedPaths;
+        // run state, written to / restored from checkpoints
+        int iteration = 0;
+        double startingTemp = 0;
+        double coolingFactor = 0.05;
+        double prevErr = 0;
+        vector<int> cells;
+        vector<int> bestCells;
+        vector<double> errorHistory;
+        std::mt19937 engine;
+        bool resumed = false;
+        std::string checkpointPath;
+        int checkpointEvery = 0;
+        std::future<void> pendingCheckpoint;
+        std::function<void(int, int, bool)> progressCallback;
+        std::atomic<bool>* cancelFlag = nullptr;
+        // workers simulate without seeds and return no poses, so warm starts are local only
+        bool warmStarting() { return warmStart && !remote; };
+        std::string serializeState();
+        void writeCheckpoint();
     public:
         SimulatedAnnealingSet(std::vector<MMGrid> startGrids, double dofWeight, double pathWeight);
+        // threads used to simulate the path sets of the candidates concurrently (0 = one per path set and candidate,
+        // up to the core count; 1 = serial)
+        void setNumThreads(int numThreads) { this->numThreads = numThreads; };
+        // evaluations are memoized in cache (kept across runs); without one, each run uses its own
+        void setCache(FitnessCache* cache) { this->cache = cache; };
+        // on-disk evaluation store shared with other runs and processes
+        void setPersistentCache(PersistentCache* store) { this->store = store; };
+        // simulate candidates on dynamic_mm_worker processes
+        void setRemote(RemoteEvaluator* remote) { this->remote = remote; };
+        // mutations of the current layout evaluated together per iteration, the best one competes for acceptance;
+        // more than one is only worth it with enough workers or threads to simulate them at the same time
+        void setCandidatesPerIteration(int k) { candidatesPerIteration = std::max(1, k); };
+        // seed candidate simulations with the current layout's converged poses (see CandidateEvaluator::setWarmStart);
+        // ignored with remote workers
+        void setWarmStart(bool warmStart) { this->warmStart = warmStart; };
+        // evaluate with QuasiStaticSolver instead of the Chipmunk simulation
+        void setQuasiStatic(bool quasiStatic) { this->quasiStatic = quasiStatic; };
+        // write the run state to filePath every `every` iterations (and at the end); the file is written
+        // in the background to filePath.tmp and renamed, so a crash leaves the previous checkpoint intact
+        void setCheckpoint(std::string filePath, int every);
+        // restore a checkpoint written for the same path sets; the next simulate continues from its iteration
+        // (with the checkpoint's cooling schedule) up to numIterations, which may extend a finished run
+        bool resume(std::string filePath);
+        // called from the annealing thread after every iteration with (iterations done, numIterations, new best found)
+        void setProgressCallback(std::function<void(int, int, bool)> callback) { progressCallback = callback; };
+        // simulate returns the best layout so far once *cancel becomes true
+        void setCancelFlag(std::atomic<bool>* cancel) { cancelFlag = cancel; };
         MMGrid simulate(int numIterations, double coolingFactor = 0.05);
-};
\ No newline at end of file
+        int getIteration() { return iteration; };
+        // weighted error of the current layout at the start of every iteration
+        vector<double> getErrorHistory() { return errorHistory; };
+        double getBestError() { return bestErr; };
+        vector<int> getBestCells() { return bestCells; };
+        // calculated paths of the best layout, one slot per path set
+        vector<vector<vector<cpVect>>> getCalculatedPaths() { return calculatedPaths; };
+};
@@ -0,0 +1,51 @@
+#include "SimulationProfile.hpp"
+
+void SimulationProfile::apply(cpSpace *space) const
+{
+    cpSpaceSetIterations(space, iterations);
+    cpSpaceSetCollisionSlop(space, collisionSlop);
+    cpSpaceSetCollisionBias(space, collisionBias);
+    cpSpaceSetSleepTimeThreshold(space, sleepTimeThreshold);
+    cpSpaceSetIdleSpeedThreshold(space, idleSpeedThreshold);
+    cpSpaceSetDamping(space, damping);
+}
+
+bool SimulationProfile::isDefault() const
+{
+    SimulationProfile defaults;
+    return iterations == defaults.iterations && collisionSlop == defaults.collisionSlop && collisionBias == defaults.collisionBias &&
+        sleepTimeThreshold == defaults.sleepTimeThreshold && idleSpeedThreshold == defaults.idleSpeedThreshold && damping == defaults.damping;
+}
+
+// few iterations leave the pivots slightly loose, and some velocity damping lets every path point settle sooner
+SimulationProfile SimulationProfile::fastSearch()
+{
+    SimulationProfile profile;
+    profile.name = "fast";
+    profile.iterations = 4;
+    profile.damping = 0.5;
+    return profile;
+}
+
+// stiff pivots and tight contacts; no damping, so equilibria are the same as with the default profile
+SimulationProfile SimulationProfile::accurateVerify()
+{
+    SimulationProfile profile;
+    profile.name = "accurate";
+    profile.iterations = 30;
+    profile.collisionSlop = 0.01;
+    return profile;
+}
+
+bool SimulationProfile::byName(const std::string &name, SimulationProfile &profile)
+{
+    if (name == "default")
+        profile = SimulationProfile();
+    else if (name == "fast")
+        profile = fastSearch();
+    else if (name == "accurate")
+        profile = accurateVerify();
+    else
+        return false;
+    return true;
+}
@@ -0,0 +1,29 @@
+#include <cmath>
+#include <string>
+#include <vector>
+#include "chipmunk/chipmunk.h"
+
+#pragma once
+
+// Chipmunk solver settings of a simulation. The defaults are Chipmunk's own; fastSearch trades constraint accuracy
+// for step cost during optimization, accurateVerify does the opposite to check final designs.
+struct SimulationProfile {
+    std::string name = "default";
+    // constraint solver iterations per step
+    int iterations = 10;
+    // allowed shape overlap, and the fraction of it left uncorrected after a second (only with link collisions)
+    cpFloat collisionSlop = 0.1;
+    cpFloat collisionBias = pow((cpFloat)(1.0f - 0.1f), 60.0);
+    // idle bodies sleep after this long below idleSpeedThreshold (0 lets Chipmunk estimate it); INFINITY never sleeps
+    cpFloat sleepTimeThreshold = INFINITY;
+    cpFloat idleSpeedThreshold = 0;
+    // fraction of their velocity bodies keep per second
+    cpFloat damping = 1;
+    void apply(cpSpace *space) const;
+    bool isDefault() const;
+    static SimulationProfile fastSearch();
+    static SimulationProfile accurateVerify();
+    // "default", "fast" or "accurate"; false (profile unchanged) for other names
+    static bool byName(const std::string &name, SimulationProfile &profile);
+    static std::vector<std::string> names() { return {"default", "fast", "accurate"}; };
+};
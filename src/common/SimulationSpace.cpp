@@ -14,6 +14,10 @@ void SimulationSpace::setGravity(Position gravity) const {
     cpSpaceSetGravity(mySpace, cpv(gravity[0], gravity[1]));
 }
 
+void SimulationSpace::setProfile(const SimulationProfile& profile) const {
+    profile.apply(mySpace);
+}
+
 SimulationBody SimulationSpace::addSegmentBody(Position start, Position end, double mass, double radius) const {
     cpVect sv = cpv(start[0], start[1]), ev = cpv(end[0], end[1]);
     cpVect pos = (sv + ev) * (1.0 / 2.0);
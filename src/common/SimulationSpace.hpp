@@ -3,6 +3,7 @@
 #include <unordered_map>
 #include <memory>
 #include "Position.hpp"
+#include "SimulationProfile.hpp"
 
 #pragma once
 
@@ -52,6 +53,7 @@ class SimulationSpace {
         SimulationSpace(double timestep);
         void step() const;
         void setGravity(Position gravity) const;
+        void setProfile(const SimulationProfile& profile) const;
         SimulationBody addSegmentBody(Position start, Position end, double mass, double radius) const;
         SimulationBody addCircleBody(Position center, double mass, double innerRadius, double outerRadius) const;
         SimulationBody addStaticSegmentBody(Position start, Position end, double radius) const;
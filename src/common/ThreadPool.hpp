@@ -0,0 +1,38 @@
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#pragma once
+
+// Fixed-size pool of worker threads; used to evaluate independent candidates (each owns its own cpSpace) concurrently.
+class ThreadPool {
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex queueMutex;
+        std::condition_variable condition;
+        bool stopping = false;
+        void work();
+    public:
+        // numThreads <= 0 uses one thread per hardware core
+        ThreadPool(int numThreads = 0);
+        ~ThreadPool();
+        int size() { return workers.size(); };
+        template <typename F>
+        auto submit(F task) -> std::future<decltype(task())> {
+            using R = decltype(task());
+            auto packaged = std::make_shared<std::packaged_task<R()>>(std::move(task));
+            std::future<R> result = packaged->get_future();
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                tasks.push([packaged]() { (*packaged)(); });
+            }
+            condition.notify_one();
+            return result;
+        };
+};
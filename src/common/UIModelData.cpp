@@ -24,8 +24,14 @@ float UIModelData::simTimestep = 0.01;
 float UIModelData::playbackPointsPerSecond = 2;
 
 int UIModelData::annealingSteps = 20;
+int UIModelData::annealingCandidates = 1;
 float UIModelData::pathWeight = 2.0;
 float UIModelData::dofWeight = 3.0;
+FitnessCache UIModelData::fitnessCache;
+// after fitnessCache, so a running optimization is joined before the cache it uses goes away
+BackgroundOptimizer UIModelData::optimizer;
+OptimizerSnapshot UIModelData::optimizerSnapshot;
+MMGridState UIModelData::restState;
 
 std::unordered_map<std::string, std::vector<cpVect>> UIModelData::paths = {};
 string UIModelData::pathSelection = "";
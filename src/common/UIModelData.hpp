@@ -1,5 +1,9 @@
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include "MMGrid.hpp"
+#include "FitnessCache.hpp"
+#include "BackgroundOptimizer.hpp"
 
 #pragma once
 class UIModelData
@@ -31,8 +35,15 @@ public:
 	static float playbackPointsPerSecond;
 
 	static int annealingSteps;
+	// mutations simulated together per annealing iteration
+	static int annealingCandidates;
 	static float pathWeight;
 	static float dofWeight;
+	static FitnessCache fitnessCache;
+	static BackgroundOptimizer optimizer;
+	static OptimizerSnapshot optimizerSnapshot;
+	// state of the model grid right after its cells were applied, "reset simulation" returns to it
+	static MMGridState restState;
 
 	static std::unordered_map<std::string, std::vector<cpVect>> paths;
 	static string pathSelection;
@@ -0,0 +1,344 @@
+#include "WorkerProtocol.hpp"
+#include <cstring>
+#include <unordered_map>
+#include "PersistentCache.hpp"
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    template <typename T>
+    void put(std::string& buffer, T value)
+    {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        buffer.append(bytes, sizeof(T));
+    }
+
+    // reads sequentially from a payload, every read fails once the payload is exhausted
+    struct Reader {
+        const std::string& data;
+        size_t offset = 0;
+        bool ok = true;
+        Reader(const std::string& data) : data(data) {}
+        template <typename T>
+        T get()
+        {
+            T value{};
+            if (!ok || offset + sizeof(T) > data.size())
+            {
+                ok = false;
+                return value;
+            }
+            std::memcpy(&value, data.data() + offset, sizeof(T));
+            offset += sizeof(T);
+            return value;
+        }
+        // a uint32 element count, which fails if the rest of the payload can't hold that many elements of at least
+        // elementSize bytes, so a corrupt count never allocates more than the payload's size
+        uint32_t count(size_t elementSize)
+        {
+            uint32_t n = get<uint32_t>();
+            if (ok && n > (data.size() - offset) / elementSize)
+                ok = false;
+            return ok ? n : 0;
+        }
+        std::string bytes(size_t n)
+        {
+            if (!ok || offset + n > data.size())
+            {
+                ok = false;
+                return "";
+            }
+            std::string value = data.substr(offset, n);
+            offset += n;
+            return value;
+        }
+    };
+
+    void putPaths(std::string& buffer, const vector<vector<cpVect>>& paths)
+    {
+        put<uint32_t>(buffer, paths.size());
+        for (auto& path : paths)
+        {
+            put<uint32_t>(buffer, path.size());
+            for (cpVect p : path)
+            {
+                put<double>(buffer, p.x);
+                put<double>(buffer, p.y);
+            }
+        }
+    }
+
+    vector<vector<cpVect>> getPaths(Reader& in)
+    {
+        // every path takes at least its point count, every point two doubles
+        vector<vector<cpVect>> paths(in.count(sizeof(uint32_t)));
+        for (auto& path : paths)
+        {
+            uint32_t n = in.count(2 * sizeof(double));
+            if (!in.ok)
+                break;
+            path.resize(n);
+            for (cpVect& p : path)
+            {
+                p.x = in.get<double>();
+                p.y = in.get<double>();
+            }
+        }
+        return paths;
+    }
+
+    std::string frame(const std::string& payload)
+    {
+        std::string buffer;
+        put<uint32_t>(buffer, payload.size());
+        return buffer + payload;
+    }
+}
+
+namespace WorkerProtocol {
+
+std::string encodeContext(MMGrid& grid)
+{
+    std::string context;
+    put<int32_t>(context, grid.getRows());
+    put<int32_t>(context, grid.getCols());
+    put<double>(context, grid.getLinkMass());
+    put<double>(context, grid.getBevel());
+    put<double>(context, grid.getStiffness());
+    put<double>(context, grid.getDamping());
+    put<int32_t>(context, grid.getShrinkFactor());
+    vector<int> anchors = grid.getAnchors();
+    put<uint32_t>(context, anchors.size());
+    for (int a : anchors)
+        put<int32_t>(context, a);
+    vector<int> targets = grid.getTargets();
+    put<uint32_t>(context, targets.size());
+    for (int t : targets)
+        put<int32_t>(context, t);
+    putPaths(context, grid.getTargetPaths());
+    ConvergenceSettings convergence = grid.getConvergence();
+    put<double>(context, convergence.haltDelta);
+    put<double>(context, convergence.energyTolerance);
+    put<int32_t>(context, convergence.calmSteps);
+    put<double>(context, convergence.residualTolerance);
+    put<double>(context, convergence.timeStep);
+    put<double>(context, convergence.maxTimeStep);
+    put<double>(context, convergence.timeStepGrowth);
+    put<int32_t>(context, convergence.maxSteps);
+    put<uint8_t>(context, grid.getCollisions() ? 1 : 0);
+    SimulationProfile profile = grid.getProfile();
+    put<int32_t>(context, profile.iterations);
+    put<double>(context, profile.collisionSlop);
+    put<double>(context, profile.collisionBias);
+    put<double>(context, profile.sleepTimeThreshold);
+    put<double>(context, profile.idleSpeedThreshold);
+    put<double>(context, profile.damping);
+    put<int32_t>(context, grid.getStepThreads());
+    put<uint8_t>(context, grid.getGridSolver() ? 1 : 0);
+    return context;
+}
+
+std::unique_ptr<MMGrid> decodeContext(const std::string& context)
+{
+    Reader in(context);
+    int rows = in.get<int32_t>(), cols = in.get<int32_t>();
+    double linkMass = in.get<double>(), bevel = in.get<double>(), stiffness = in.get<double>(), damping = in.get<double>();
+    int shrinkFactor = in.get<int32_t>();
+    vector<int> anchors(in.count(sizeof(int32_t)));
+    for (int& a : anchors)
+        a = in.get<int32_t>();
+    vector<int> targets(in.count(sizeof(int32_t)));
+    for (int& t : targets)
+        t = in.get<int32_t>();
+    vector<vector<cpVect>> targetPaths = getPaths(in);
+    ConvergenceSettings convergence;
+    convergence.haltDelta = in.get<double>();
+    convergence.energyTolerance = in.get<double>();
+    convergence.calmSteps = in.get<int32_t>();
+    convergence.residualTolerance = in.get<double>();
+    convergence.timeStep = in.get<double>();
+    convergence.maxTimeStep = in.get<double>();
+    convergence.timeStepGrowth = in.get<double>();
+    convergence.maxSteps = in.get<int32_t>();
+    bool collisions = in.get<uint8_t>() != 0;
+    SimulationProfile profile;
+    profile.name = "remote";
+    profile.iterations = in.get<int32_t>();
+    profile.collisionSlop = in.get<double>();
+    profile.collisionBias = in.get<double>();
+    profile.sleepTimeThreshold = in.get<double>();
+    profile.idleSpeedThreshold = in.get<double>();
+    profile.damping = in.get<double>();
+    int stepThreads = in.get<int32_t>();
+    bool gridSolver = in.get<uint8_t>() != 0;
+    // no request could carry the cells of a larger grid
+    if (!in.ok || rows <= 0 || cols <= 0 || (int64_t)rows * cols > maxFrameSize / sizeof(int32_t) || targets.size() != targetPaths.size())
+        return nullptr;
+    int numJoints = (rows + 1) * (cols + 1);
+    for (vector<int>* joints : { &anchors, &targets })
+        for (int j : *joints)
+            if (j < 0 || j >= numJoints)
+                return nullptr;
+
+    std::unique_ptr<MMGrid> grid = std::make_unique<MMGrid>(rows, cols, vector<int>(rows * cols));
+    grid->setLinkMass(linkMass);
+    grid->setBevel(bevel);
+    grid->setStiffness(stiffness);
+    grid->setDamping(damping);
+    grid->setShrinkFactor(shrinkFactor);
+    for (int a : anchors)
+        grid->anchor(a);
+    grid->setTargetPaths(targets, targetPaths);
+    grid->setConvergence(convergence);
+    grid->setCollisions(collisions);
+    grid->setProfile(profile);
+    grid->setStepThreads(stepThreads);
+    grid->setGridSolver(gridSolver);
+    return grid;
+}
+
+void encodeRequest(const Request& request, std::string& buffer)
+{
+    std::string payload;
+    put<uint64_t>(payload, request.jobId);
+    put<uint32_t>(payload, request.context.size());
+    payload += request.context;
+    put<uint32_t>(payload, request.cells.size());
+    for (int c : request.cells)
+        put<int32_t>(payload, c);
+    put<double>(payload, request.pathBudget);
+    buffer += frame(payload);
+}
+
+void encodeReply(const Reply& reply, std::string& buffer)
+{
+    std::string payload;
+    put<uint64_t>(payload, reply.jobId);
+    put<double>(payload, reply.pathError);
+    put<uint8_t>(payload, reply.aborted ? 1 : 0);
+    putPaths(payload, reply.calculatedPaths);
+    buffer += frame(payload);
+}
+
+bool decodeRequest(const std::string& payload, Request& request)
+{
+    Reader in(payload);
+    request.jobId = in.get<uint64_t>();
+    request.context = in.bytes(in.get<uint32_t>());
+    request.cells.resize(in.count(sizeof(int32_t)));
+    if (!in.ok)
+        return false;
+    for (int& c : request.cells)
+        c = in.get<int32_t>();
+    request.pathBudget = in.get<double>();
+    return in.ok;
+}
+
+bool decodeReply(const std::string& payload, Reply& reply)
+{
+    Reader in(payload);
+    reply.jobId = in.get<uint64_t>();
+    reply.pathError = in.get<double>();
+    reply.aborted = in.get<uint8_t>() != 0;
+    reply.calculatedPaths = getPaths(in);
+    return in.ok;
+}
+
+#ifndef _WIN32
+
+bool sendAll(int fd, const std::string& buffer)
+{
+    size_t sent = 0;
+    while (sent < buffer.size())
+    {
+        ssize_t n = send(fd, buffer.data() + sent, buffer.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+static bool receiveAll(int fd, char* data, size_t size)
+{
+    size_t received = 0;
+    while (received < size)
+    {
+        ssize_t n = recv(fd, data + received, size - received, 0);
+        if (n <= 0)
+            return false;
+        received += n;
+    }
+    return true;
+}
+
+bool receiveFrame(int fd, std::string& payload)
+{
+    uint32_t size;
+    if (!receiveAll(fd, (char*)&size, sizeof(size)) || size > maxFrameSize)
+        return false;
+    payload.resize(size);
+    return size == 0 || receiveAll(fd, &payload[0], size);
+}
+
+void serve(int fd)
+{
+    // one simulation grid per context, re-used with applyCells
+    std::unordered_map<uint64_t, std::unique_ptr<MMGrid>> grids;
+    std::string payload;
+    while (receiveFrame(fd, payload))
+    {
+        Request request;
+        if (!decodeRequest(payload, request))
+        {
+            std::cout << "malformed request, closing connection" << std::endl;
+            break;
+        }
+        uint64_t contextHash = PersistentCache::hash(request.context);
+        auto it = grids.find(contextHash);
+        if (it == grids.end())
+        {
+            std::unique_ptr<MMGrid> grid = decodeContext(request.context);
+            if (!grid)
+            {
+                std::cout << "malformed context, closing connection" << std::endl;
+                break;
+            }
+            it = grids.emplace(contextHash, std::move(grid)).first;
+        }
+        MMGrid& grid = *it->second;
+        Reply reply;
+        reply.jobId = request.jobId;
+        if (request.cells.size() == grid.getRows() * grid.getCols())
+        {
+            grid.applyCells(request.cells);
+            reply.pathError = grid.getPathError(request.pathBudget);
+            reply.aborted = reply.pathError > request.pathBudget;
+            reply.calculatedPaths = grid.getCalculatedPaths();
+        }
+        else
+        {
+            // can't be simulated, reported as over any budget
+            reply.pathError = DBL_MAX;
+            reply.aborted = true;
+        }
+        std::string buffer;
+        encodeReply(reply, buffer);
+        if (!sendAll(fd, buffer))
+            break;
+    }
+    close(fd);
+}
+
+#else
+
+bool sendAll(int fd, const std::string& buffer) { return false; }
+bool receiveFrame(int fd, std::string& payload) { return false; }
+void serve(int fd) {}
+
+#endif
+
+}
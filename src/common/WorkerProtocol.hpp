@@ -0,0 +1,49 @@
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "MMGrid.hpp"
+
+#pragma once
+
+// Messages between the optimizers and dynamic_mm_worker processes. Every message is a frame:
+// uint32 payload length, then the payload, all in host byte order (workers run on the same kind of machine).
+//
+// request: uint64 job id, context (see encodeContext), uint32 #cells, int32 cells..., double path error budget
+// reply:   uint64 job id, double path error, uint8 aborted, calculated paths (uint32 #paths, per path uint32 #points, x y...)
+//
+// A request carries everything needed to simulate, so any worker can take any job and a lost one can simply be
+// sent again; workers keep one grid per context and only apply the cells of every new request.
+namespace WorkerProtocol {
+    // longer frames are refused, their length prefix is corrupt (or hostile)
+    const uint32_t maxFrameSize = 64 << 20;
+
+    struct Request {
+        uint64_t jobId = 0;
+        std::string context;
+        vector<int> cells;
+        double pathBudget = DBL_MAX;
+    };
+    struct Reply {
+        uint64_t jobId = 0;
+        double pathError = 0;
+        bool aborted = false;
+        vector<vector<cpVect>> calculatedPaths;
+    };
+
+    // grid size, simulation parameters, anchors, target paths, convergence settings, collisions and solver profile of a path set
+    std::string encodeContext(MMGrid& grid);
+    std::unique_ptr<MMGrid> decodeContext(const std::string& context);
+
+    // frame (length prefix included) appended to buffer
+    void encodeRequest(const Request& request, std::string& buffer);
+    void encodeReply(const Reply& reply, std::string& buffer);
+    bool decodeRequest(const std::string& payload, Request& request);
+    bool decodeReply(const std::string& payload, Reply& reply);
+
+    // blocking socket I/O, false once the peer is gone (or the socket's receive timeout expired, or a frame is too long)
+    bool sendAll(int fd, const std::string& buffer);
+    bool receiveFrame(int fd, std::string& payload);
+
+    // answers requests on a connected socket until the peer disconnects
+    void serve(int fd);
+}
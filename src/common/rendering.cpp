@@ -82,11 +82,11 @@ std::pair<MatrixX3d, MatrixX3i> generateCapsule(Vector3d base, double r, double
     return std::make_pair(V, F);
 }
 
-std::pair<MatrixX3d, MatrixX3i> combineMeshes(std::vector<std::pair<MatrixX3d, MatrixX3i>> meshes)
+std::pair<MatrixX3d, MatrixX3i> combineMeshes(const std::vector<std::pair<MatrixX3d, MatrixX3i>>& meshes)
 {
     int vrows = 0;
     int frows = 0;
-    for(auto mesh : meshes) {
+    for(auto& mesh : meshes) {
         vrows += mesh.first.rows();
         frows += mesh.second.rows();
     }
@@ -94,15 +94,48 @@ std::pair<MatrixX3d, MatrixX3i> combineMeshes(std::vector<std::pair<MatrixX3d, M
     MatrixX3i F(frows, 3);
     int v_offset = 0;
     int f_offset = 0;
-    for(auto mesh : meshes) {
-        auto v = mesh.first;
-        auto f = mesh.second;
+    for(auto& mesh : meshes) {
+        const MatrixX3d& v = mesh.first;
+        const MatrixX3i& f = mesh.second;
         V.middleRows(v_offset, v.rows()) = v;
-        MatrixX3i indexOffset = MatrixX3i::Constant(f.rows(), 3, v_offset);
-        MatrixX3i new_faces = f + indexOffset;
-        F.middleRows(f_offset, f.rows()) = new_faces;
+        F.middleRows(f_offset, f.rows()) = f.array() + v_offset;
         v_offset += v.rows();
         f_offset += f.rows();
     }
     return std::make_pair(V, F);
+}
+
+CapsuleTemplate makeCapsuleTemplate(double r, double h, int res)
+{
+    CapsuleTemplate capsule;
+    capsule.r = r;
+    capsule.h = h;
+    capsule.res = res;
+    std::pair<MatrixX3d, MatrixX3i> mesh = generateCapsule(Vector3d::Zero(), r, h, res, 0);
+    capsule.V = mesh.first;
+    capsule.F = mesh.second;
+    return capsule;
+}
+
+MatrixX3i instanceFaces(const CapsuleTemplate& capsule, int n)
+{
+    int nv = capsule.V.rows(), nf = capsule.F.rows();
+    MatrixX3i F(n * nf, 3);
+    for (int i = 0; i < n; i++)
+        F.middleRows(i * nf, nf) = capsule.F.array() + i * nv;
+    return F;
+}
+
+void placeCapsules(const CapsuleTemplate& capsule, const MatrixX3d& poses, MatrixX3d& V)
+{
+    int nv = capsule.V.rows();
+    // the template's z column never changes, only x and y are rotated
+    for (int i = 0; i < poses.rows(); i++)
+    {
+        double c = cos(poses(i, 2)), s = sin(poses(i, 2));
+        auto block = V.middleRows(i * nv, nv);
+        block.col(0) = (capsule.V.col(0) * c - capsule.V.col(1) * s).array() + poses(i, 0);
+        block.col(1) = (capsule.V.col(0) * s + capsule.V.col(1) * c).array() + poses(i, 1);
+        block.col(2) = capsule.V.col(2);
+    }
 }
\ No newline at end of file
@@ -1,7 +1,25 @@
 #define _CRT_SECURE_NO_WARNINGS
 
-#include <igl/opengl/glfw/Viewer.h>
+#include <utility>
+#include <vector>
+#include <Eigen/Dense>
 
 using namespace Eigen;
 std::pair<MatrixX3d, MatrixX3i> generateCapsule(Vector3d base, double r, double h, int res, double rot);
-std::pair<MatrixX3d, MatrixX3i> combineMeshes(std::vector<std::pair<MatrixX3d, MatrixX3i>> meshes);
\ No newline at end of file
+std::pair<MatrixX3d, MatrixX3i> combineMeshes(const std::vector<std::pair<MatrixX3d, MatrixX3i>>& meshes);
+
+// generateCapsule at the origin, tessellated once per (r, h, res) and placed any number of times by placeCapsules
+struct CapsuleTemplate {
+    double r = 0;
+    double h = 0;
+    int res = 0;
+    MatrixX3d V;
+    MatrixX3i F;
+    bool matches(double r, double h, int res) const { return res == this->res && r == this->r && h == this->h; };
+};
+CapsuleTemplate makeCapsuleTemplate(double r, double h, int res);
+// faces of n instances, instance i using vertex rows i * V.rows() onwards; only changes with the topology
+MatrixX3i instanceFaces(const CapsuleTemplate& capsule, int n);
+// per instance i, the template rotated by poses(i, 2) about z and moved to (poses(i, 0), poses(i, 1)) is written to
+// V from row i * capsule.V.rows(); V must already hold poses.rows() instances
+void placeCapsules(const CapsuleTemplate& capsule, const MatrixX3d& poses, MatrixX3d& V);
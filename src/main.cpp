@@ -401,6 +401,7 @@ void main_verify()
 	int selected_joint = 0;
 	int select_mode = 0;
 	int iterations = 20;
+	int candidates = 1;
 	bool edit_enabled = false;
 	char editMode = 'r';
 	bool following_path = false;
@@ -481,9 +482,11 @@ void main_verify()
 		if (ImGui::CollapsingHeader("Optimization", ImGuiTreeNodeFlags_DefaultOpen))
 		{
 			ImGui::InputInt("Optimization Iterations", &iterations);
+			ImGui::InputInt("Candidates per Iteration", &candidates);
 			if (ImGui::Button("Generate Cell Placement"))
 			{
 				SimulatedAnnealing sa(myGrid, 2, 3);
+				sa.setParallelCandidates(candidates);
 				MMGrid newGrid = sa.simulate(iterations);
 				rows = newGrid.getRows();
 				cols = newGrid.getCols();
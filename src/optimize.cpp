@@ -0,0 +1,429 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "common/SimulatedAnnealingSet.hpp"
+#include "common/ParallelTempering.hpp"
+#include "common/ExhaustiveSearch.hpp"
+#include "common/QuasiStaticSolver.hpp"
+#include "common/PRand.hpp"
+
+// Headless optimizer: runs SimulatedAnnealingSet on one or more path sets without a viewer.
+//
+// usage: dynamic_mm_optimize <config> [options]
+//   --set <config>          add another path set (anchors + target paths) for the same layout
+//   --path <joint> <file>   attach a path file (see paths/) to a joint of the last path set
+//   --iterations <n>        annealing iterations (default 20)
+//   --path-weight <w>       weight of the path error (default 2)
+//   --dof-weight <w>        weight of the degrees of freedom (default 3)
+//   --cooling <c>           cooling factor (default 0.05)
+//   --threads <n>           threads simulating the path sets of the candidates (default: one per path set and candidate),
+//                           with --exhaustive designs evaluated concurrently (default: all cores)
+//   --replicas <n>          use parallel tempering with n replicas (0 = one per core) instead of annealing
+//   --temperatures <lo> <hi>  temperature range of the replicas (default 0.5 50)
+//   --swap-interval <n>     iterations between replica exchanges (default 5)
+//   --exhaustive            evaluate every distinct design (small grids only) and return the optimum
+//   --cache-file <file>     reuse and extend an on-disk evaluation cache (can be shared by concurrent runs)
+//   --checkpoint <file>     write the annealing state to file every --checkpoint-every iterations (default 10)
+//   --resume <file>         continue an annealing run from a checkpoint (--iterations may extend it)
+//   --workers <h:p>,...     simulate on dynamic_mm_worker processes (an endpoint listed n times gets n jobs at once)
+//   --candidates <k>        annealing candidates per iteration, simulated at the same time on the workers or
+//                           on --threads (default 1); the best one competes for acceptance
+//   --warm-start            start each candidate's path points from the current layout's converged poses
+//                           (local simulations only, ignored with --workers)
+//   --worker-timeout <ms>   drop a worker that has not answered for this long and resubmit its jobs (default 30000)
+//   --solver <s>            how path errors are computed: dynamic (Chipmunk simulation, default) or quasi-static
+//   --cross-validate <n>    instead of optimizing, compare both solvers on the start layout and n mutations of it
+//   --halt-delta <d>        a simulation step is calm when the target error changes by less than d (default 1e-4)
+//   --energy-tolerance <e>  ... and the links' kinetic energy is below e (default 0: not checked)
+//   --calm-steps <n>        calm steps in a row before moving on to the next path point (default 1)
+//   --residual-tolerance <r>  also move on once the target error is below r (default 0: not checked)
+//   --time-step <dt>        simulation time step (default 0.5/60)
+//   --max-time-step <dt>    calm steps grow the time step by half up to dt (default: no growth)
+//   --max-steps <n>         simulation steps after which an unsettled path point is given up (default 0: no limit)
+//   --collisions            give the links collision shapes (by default they only interact through pivots and springs)
+//   --profile <p>           Chipmunk solver settings: default, fast (for searching) or accurate (for verifying)
+//   --step-threads <n>      threads stepping each simulation (default 1), on top of --threads; needs large grids to pay off
+//   --grid-solver           step simulations with the structure-of-arrays grid solver instead of Chipmunk's
+//   --out <prefix>          writes <prefix>.txt (best model + paths) and <prefix>_paths.txt (calculated paths)
+
+void print_usage()
+{
+	std::cout << "usage: dynamic_mm_optimize <config> [--set <config>]... [--path <joint> <file>]..." << std::endl;
+	std::cout << "                           [--iterations <n>] [--path-weight <w>] [--dof-weight <w>]" << std::endl;
+	std::cout << "                           [--cooling <c>] [--threads <n>] [--out <prefix>]" << std::endl;
+	std::cout << "                           [--replicas <n>] [--temperatures <lo> <hi>] [--swap-interval <n>] [--exhaustive]" << std::endl;
+	std::cout << "                           [--cache-file <file>] [--checkpoint <file>] [--checkpoint-every <n>]" << std::endl;
+	std::cout << "                           [--resume <file>] [--workers <host:port>,...] [--candidates <k>]" << std::endl;
+	std::cout << "                           [--worker-timeout <ms>] [--warm-start] [--solver dynamic|quasi-static]" << std::endl;
+	std::cout << "                           [--cross-validate <n>] [--halt-delta <d>] [--energy-tolerance <e>]" << std::endl;
+	std::cout << "                           [--calm-steps <n>] [--residual-tolerance <r>] [--time-step <dt>]" << std::endl;
+	std::cout << "                           [--max-time-step <dt>] [--max-steps <n>] [--collisions]" << std::endl;
+	std::cout << "                           [--profile default|fast|accurate] [--step-threads <n>]" << std::endl;
+	std::cout << "                           [--grid-solver]" << std::endl;
+}
+
+void write_calculated_paths(std::string filePath, std::vector<MMGrid>& gridSet, vector<vector<vector<cpVect>>> calculatedPaths)
+{
+	ofstream file(filePath);
+	if (!file.good())
+	{
+		std::cout << "file " << filePath << " not found!" << std::endl;
+		return;
+	}
+	file << calculatedPaths.size() << std::endl;
+	for (int s = 0; s < calculatedPaths.size(); s++)
+	{
+		vector<int> targets = gridSet[s].getTargets();
+		file << std::endl;
+		file << "#set " << s << std::endl;
+		for (int t = 0; t < calculatedPaths[s].size(); t++)
+		{
+			file << targets[t] << " " << calculatedPaths[s][t].size() << std::endl;
+			for (cpVect p : calculatedPaths[s][t])
+			{
+				file << p.x << " " << p.y << std::endl;
+			}
+		}
+	}
+	file.close();
+}
+
+// path errors of the start layout and n mutations of it, simulated and solved quasi-statically, per path set
+void cross_validate(std::vector<MMGrid>& gridSet, int n)
+{
+	int rows = gridSet[0].getRows(), cols = gridSet[0].getCols();
+	std::vector<vector<int>> layouts = { gridSet[0].getCells() };
+	seedRandom(time(NULL));
+	for (int i = 0; i < n; i++)
+	{
+		ConstraintGraph cg(rows, cols, gridSet[0].getCells());
+		cg.mutate();
+		layouts.push_back(cg.makeCells());
+	}
+
+	double simTime = 0, qsTime = 0, maxDeviation = 0;
+	long steps = 0, iterations = 0, factorizations = 0;
+	for (int l = 0; l < layouts.size(); l++)
+	{
+		for (int s = 0; s < gridSet.size(); s++)
+		{
+			MMGrid sim(gridSet[s]);
+			sim.applyCells(layouts[l]);
+			auto start = std::chrono::steady_clock::now();
+			double simErr = sim.getPathError();
+			auto simulated = std::chrono::steady_clock::now();
+			QuasiStaticSolver solver(gridSet[s]);
+			double qsErr = solver.getPathError(layouts[l]);
+			auto solved = std::chrono::steady_clock::now();
+			double simMs = std::chrono::duration<double, std::milli>(simulated - start).count();
+			double qsMs = std::chrono::duration<double, std::milli>(solved - simulated).count();
+
+			// furthest apart the two solvers put a target joint at any path point
+			vector<vector<cpVect>> simPaths = sim.getCalculatedPaths(), qsPaths = solver.getCalculatedPaths();
+			double deviation = 0;
+			for (int t = 0; t < std::min(simPaths.size(), qsPaths.size()); t++)
+				for (int p = 0; p < std::min(simPaths[t].size(), qsPaths[t].size()); p++)
+					deviation = std::max(deviation, cpvdist(simPaths[t][p], qsPaths[t][p]));
+
+			std::cout << (l == 0 ? "start" : "mutation " + std::to_string(l)) << ", set " << s << ": simulated " << simErr
+				<< " (" << sim.getLastIterations() << " steps, " << simMs << " ms), quasi-static " << qsErr
+				<< " (" << solver.getLastIterations() << " iterations, " << solver.getLastFactorizations() << " factorizations, "
+				<< qsMs << " ms), max path deviation " << deviation << std::endl;
+			simTime += simMs;
+			qsTime += qsMs;
+			steps += sim.getLastIterations();
+			iterations += solver.getLastIterations();
+			factorizations += solver.getLastFactorizations();
+			maxDeviation = std::max(maxDeviation, deviation);
+		}
+	}
+	std::cout << "Simulated: " << steps << " steps in " << simTime << " ms, quasi-static: " << iterations << " iterations ("
+		<< factorizations << " factorizations) in " << qsTime << " ms, max path deviation " << maxDeviation << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::vector<std::string> configs = { argv[1] };
+	std::vector<std::vector<std::pair<int, std::string>>> pathFiles = { {} };
+	int iterations = 20;
+	double pathWeight = 2.0;
+	double dofWeight = 3.0;
+	double coolingFactor = 0.05;
+	int numThreads = 0;
+	int numReplicas = -1;
+	double minTemp = 0.5, maxTemp = 50;
+	int swapInterval = 5;
+	bool exhaustive = false;
+	std::string outPrefix = "optimized";
+	std::string cacheFile;
+	std::string checkpointFile, resumeFile;
+	int checkpointEvery = 10;
+	std::vector<std::string> workers;
+	int candidates = 1;
+	int workerTimeout = 30000;
+	bool warmStart = false;
+	bool quasiStatic = false;
+	int crossValidate = -1;
+	ConvergenceSettings convergence;
+	bool maxTimeStepSet = false;
+	bool collisions = false;
+	SimulationProfile profile;
+	int stepThreads = 1;
+	bool gridSolver = false;
+
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--set" && hasValue) {
+			configs.push_back(argv[++i]);
+			pathFiles.push_back({});
+		}
+		else if (arg == "--path" && i + 2 < argc) {
+			int joint = std::atoi(argv[++i]);
+			pathFiles.back().push_back(std::make_pair(joint, std::string(argv[++i])));
+		}
+		else if (arg == "--iterations" && hasValue) {
+			iterations = std::atoi(argv[++i]);
+		}
+		else if (arg == "--path-weight" && hasValue) {
+			pathWeight = std::atof(argv[++i]);
+		}
+		else if (arg == "--dof-weight" && hasValue) {
+			dofWeight = std::atof(argv[++i]);
+		}
+		else if (arg == "--cooling" && hasValue) {
+			coolingFactor = std::atof(argv[++i]);
+		}
+		else if (arg == "--threads" && hasValue) {
+			numThreads = std::atoi(argv[++i]);
+		}
+		else if (arg == "--replicas" && hasValue) {
+			numReplicas = std::atoi(argv[++i]);
+		}
+		else if (arg == "--temperatures" && i + 2 < argc) {
+			minTemp = std::atof(argv[++i]);
+			maxTemp = std::atof(argv[++i]);
+		}
+		else if (arg == "--swap-interval" && hasValue) {
+			swapInterval = std::atoi(argv[++i]);
+		}
+		else if (arg == "--exhaustive") {
+			exhaustive = true;
+		}
+		else if (arg == "--cache-file" && hasValue) {
+			cacheFile = argv[++i];
+		}
+		else if (arg == "--checkpoint" && hasValue) {
+			checkpointFile = argv[++i];
+		}
+		else if (arg == "--checkpoint-every" && hasValue) {
+			checkpointEvery = std::atoi(argv[++i]);
+		}
+		else if (arg == "--resume" && hasValue) {
+			resumeFile = argv[++i];
+		}
+		else if (arg == "--workers" && hasValue) {
+			std::string list = argv[++i];
+			size_t begin = 0;
+			while (begin <= list.size())
+			{
+				size_t end = std::min(list.find(',', begin), list.size());
+				if (end > begin)
+					workers.push_back(list.substr(begin, end - begin));
+				begin = end + 1;
+			}
+		}
+		else if (arg == "--candidates" && hasValue) {
+			candidates = std::atoi(argv[++i]);
+		}
+		else if (arg == "--warm-start") {
+			warmStart = true;
+		}
+		else if (arg == "--worker-timeout" && hasValue) {
+			workerTimeout = std::atoi(argv[++i]);
+		}
+		else if (arg == "--solver" && hasValue) {
+			std::string solver = argv[++i];
+			if (solver != "dynamic" && solver != "quasi-static")
+			{
+				std::cout << "unknown solver " << solver << ", expected dynamic or quasi-static" << std::endl;
+				return 1;
+			}
+			quasiStatic = solver == "quasi-static";
+		}
+		else if (arg == "--cross-validate" && hasValue) {
+			crossValidate = std::max(0, std::atoi(argv[++i]));
+		}
+		else if (arg == "--halt-delta" && hasValue) {
+			convergence.haltDelta = std::atof(argv[++i]);
+		}
+		else if (arg == "--energy-tolerance" && hasValue) {
+			convergence.energyTolerance = std::atof(argv[++i]);
+		}
+		else if (arg == "--calm-steps" && hasValue) {
+			convergence.calmSteps = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--residual-tolerance" && hasValue) {
+			convergence.residualTolerance = std::atof(argv[++i]);
+		}
+		else if (arg == "--time-step" && hasValue) {
+			convergence.timeStep = std::atof(argv[++i]);
+		}
+		else if (arg == "--max-time-step" && hasValue) {
+			convergence.maxTimeStep = std::atof(argv[++i]);
+			maxTimeStepSet = true;
+		}
+		else if (arg == "--max-steps" && hasValue) {
+			convergence.maxSteps = std::max(0, std::atoi(argv[++i]));
+		}
+		else if (arg == "--profile" && hasValue) {
+			std::string name = argv[++i];
+			if (!SimulationProfile::byName(name, profile))
+			{
+				std::cout << "unknown profile " << name << ", expected default, fast or accurate" << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--step-threads" && hasValue) {
+			stepThreads = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--grid-solver") {
+			gridSolver = true;
+		}
+		else if (arg == "--collisions") {
+			collisions = true;
+		}
+		else if (arg == "--out" && hasValue) {
+			outPrefix = argv[++i];
+		}
+		else {
+			std::cout << "unknown or incomplete option " << arg << std::endl;
+			print_usage();
+			return 1;
+		}
+	}
+
+	// without --max-time-step the time step stays fixed
+	if (!maxTimeStepSet)
+		convergence.maxTimeStep = convergence.timeStep;
+
+	std::vector<MMGrid> gridSet;
+	gridSet.reserve(configs.size());
+	for (int s = 0; s < configs.size(); s++)
+	{
+		gridSet.push_back(MMGrid(1, 1, { 0 }));
+		MMGrid& grid = gridSet.back();
+		grid.loadFromFile(configs[s]);
+		for (auto& jointPath : pathFiles[s])
+		{
+			vector<cpVect> path = grid.readPath(jointPath.second);
+			if (path.size() > 0)
+				grid.setPath(path, jointPath.first);
+		}
+		if (s > 0)
+			grid.setCells(gridSet[0].getRows(), gridSet[0].getCols(), gridSet[0].getCells());
+		grid.setConvergence(convergence);
+		grid.setCollisions(collisions);
+		grid.setProfile(profile);
+		grid.setStepThreads(stepThreads);
+		grid.setGridSolver(gridSolver);
+		if (grid.getTargets().size() == 0)
+		{
+			std::cout << "path set " << s << " (" << configs[s] << ") has no target paths" << std::endl;
+			return 1;
+		}
+	}
+
+	if (crossValidate >= 0)
+	{
+		cross_validate(gridSet, crossValidate);
+		return 0;
+	}
+
+	std::unique_ptr<PersistentCache> store;
+	if (!cacheFile.empty())
+		store = std::make_unique<PersistentCache>(cacheFile);
+
+	if (numReplicas >= 0 && (!checkpointFile.empty() || !resumeFile.empty()))
+		std::cout << "checkpoints are only written for simulated annealing, --checkpoint/--resume are ignored" << std::endl;
+
+	if (quasiStatic && warmStart)
+		std::cout << "warm starts only apply to the dynamic solver, --warm-start is ignored" << std::endl;
+
+	std::unique_ptr<RemoteEvaluator> remote;
+	if (!workers.empty())
+	{
+		if (exhaustive || numReplicas >= 0)
+			std::cout << "workers are only used for simulated annealing, --workers is ignored" << std::endl;
+		else if (quasiStatic)
+			std::cout << "workers only run the dynamic solver, --workers is ignored" << std::endl;
+		else
+			remote = std::make_unique<RemoteEvaluator>(workers, workerTimeout);
+	}
+	if (remote && warmStart)
+	{
+		std::cout << "workers simulate without seeds, --warm-start is ignored with --workers" << std::endl;
+		warmStart = false;
+	}
+
+	if (exhaustive)
+	{
+		ExhaustiveSearch search(gridSet, dofWeight, pathWeight, numThreads);
+		search.setQuasiStatic(quasiStatic);
+		search.setPersistentCache(store.get());
+		MMGrid best = search.simulate();
+		best.writeConfig(outPrefix + ".txt");
+		write_calculated_paths(outPrefix + "_paths.txt", gridSet, search.getCalculatedPaths());
+		std::cout << "Best weighted error: " << search.getBestError() << std::endl;
+	}
+	else if (numReplicas >= 0)
+	{
+		ParallelTempering pt(gridSet, dofWeight, pathWeight, numReplicas);
+		pt.setTemperatures(minTemp, maxTemp);
+		pt.setSwapInterval(swapInterval);
+		pt.setQuasiStatic(quasiStatic);
+		pt.setPersistentCache(store.get());
+		MMGrid best = pt.simulate(iterations);
+		best.writeConfig(outPrefix + ".txt");
+		write_calculated_paths(outPrefix + "_paths.txt", gridSet, pt.getCalculatedPaths());
+		std::cout << "Best weighted error: " << pt.getBestError() << std::endl;
+	}
+	else
+	{
+		SimulatedAnnealingSet sa(gridSet, dofWeight, pathWeight);
+		sa.setNumThreads(numThreads);
+		sa.setQuasiStatic(quasiStatic);
+		sa.setPersistentCache(store.get());
+		sa.setRemote(remote.get());
+		sa.setCandidatesPerIteration(candidates);
+		sa.setWarmStart(warmStart);
+		if (!resumeFile.empty() && !sa.resume(resumeFile))
+			return 1;
+		// a resumed run keeps checkpointing to the file it came from
+		if (checkpointFile.empty())
+			checkpointFile = resumeFile;
+		if (!checkpointFile.empty())
+			sa.setCheckpoint(checkpointFile, checkpointEvery);
+		MMGrid best = sa.simulate(iterations, coolingFactor);
+		best.writeConfig(outPrefix + ".txt");
+		write_calculated_paths(outPrefix + "_paths.txt", gridSet, sa.getCalculatedPaths());
+		std::cout << "Best weighted error: " << sa.getBestError() << std::endl;
+	}
+	std::cout << "Wrote " << outPrefix << ".txt and " << outPrefix << "_paths.txt" << std::endl;
+	return 0;
+}
@@ -128,6 +128,10 @@ void main_draw_debug()
 					std::cout << modelPath << std::endl;
 					//UIModelData::modelGrid() = MMGrid(1, 1, { 0 });
 					UIModelData::modelGrid().loadFromFile(modelPath);
+					vector<vector<cpVect>> loadedPaths = UIModelData::modelGrid().getTargetPaths();
+					for (int c = 0; c < loadedPaths.size(); c++) {
+						UIModelData::paths.insert(std::make_pair(modelPath + "(" + std::to_string(c) + ")", loadedPaths[c]));
+					}
 					UIModelData::cells = UIModelData::modelGrid().getCells();
 					UIModelData::modelDimensions = { UIModelData::modelGrid().getRows(), UIModelData::modelGrid().getCols() };
 					rc[0] = UIModelData::modelDimensions[0];
@@ -200,7 +204,8 @@ void main_draw_debug()
 					UIModelData::modelGrid().nextPoint();
 				}
 				if (ImGui::Button("reset simulation", ImVec2(w, 0))) {
-					UIModelData::cellsEdited = true;
+					if (!UIModelData::modelGrid().restore(UIModelData::restState))
+						UIModelData::cellsEdited = true;
 				};
 				if (ImGui::Button("playback options")) {
 					UIModelData::playback_options_visible = !UIModelData::playback_options_visible;
@@ -210,19 +215,18 @@ void main_draw_debug()
 			{
 				float w = ImGui::GetContentRegionAvail().x;
 				ImGui::InputInt("# iterations", &UIModelData::annealingSteps);
-				if (ImGui::Button("optimize for paths", ImVec2(w, 0))) {
-					UIModelData::allCalculatedPaths.clear();
-					UIModelData::allCalculatedPaths.resize(UIModelData::gridSet.size());
-					SimulatedAnnealingSet sa(UIModelData::gridSet, UIModelData::pathWeight, UIModelData::dofWeight);
-					MMGrid out = sa.simulate(UIModelData::annealingSteps);
-					int index = 0;
-					for (MMGrid& grid : UIModelData::gridSet) {
-						grid.setCalculatedPaths(UIModelData::allCalculatedPaths[index]);
-						index++;
+				ImGui::InputInt("# candidates", &UIModelData::annealingCandidates);
+				if (UIModelData::optimizer.isRunning()) {
+					ImGui::ProgressBar(UIModelData::optimizer.progress(), ImVec2(w, 0));
+					ImGui::Text("iteration %d of %d, best error %.3f", UIModelData::optimizer.getIteration(), UIModelData::annealingSteps, UIModelData::optimizer.getBestError());
+					if (ImGui::Button("cancel optimization", ImVec2(w, 0))) {
+						UIModelData::optimizer.cancel();
 					}
-					UIModelData::cells = out.getCells();
-					UIModelData::cellsEdited = true;
 				}
+				else if (ImGui::Button("optimize for paths", ImVec2(w, 0))) {
+					UIModelData::optimizer.start(UIModelData::gridSet, UIModelData::pathWeight, UIModelData::dofWeight, UIModelData::annealingSteps, UIModelData::annealingCandidates, &UIModelData::fitnessCache);
+				}
+				ImGui::Text("cache: %d designs, %.0f%% hits", (int)UIModelData::fitnessCache.size(), UIModelData::fitnessCache.hitRate() * 100);
 				if (ImGui::Button("edit optimization weights", ImVec2(w, 0))) {
 					UIModelData::opt_wseights_visible = !UIModelData::opt_wseights_visible;
 				};
@@ -381,6 +385,50 @@ void main_draw_debug()
 				if (ImGui::SliderInt("Shrink Factor", &shrink_factor, 1, 8))
 					UIModelData::modelGrid().setShrinkFactor(shrink_factor);
 				ImGui::PopItemWidth();
+
+				bool collisions = UIModelData::modelGrid().getCollisions();
+				if (ImGui::Checkbox("Link Collisions", &collisions))
+					UIModelData::modelGrid().setCollisions(collisions);
+
+				// the presets fill in the Chipmunk solver settings, which can then be tuned one by one
+				SimulationProfile profile = UIModelData::modelGrid().getProfile();
+				bool profileChanged = false;
+				ImGui::PushItemWidth(-80);
+				if (ImGui::BeginCombo("Profile", profile.name.c_str())) {
+					for (std::string name : SimulationProfile::names()) {
+						if (ImGui::Selectable(name.c_str(), name == profile.name)) {
+							SimulationProfile::byName(name, profile);
+							profileChanged = true;
+						}
+					}
+					ImGui::EndCombo();
+				}
+				float spaceDamping = profile.damping, collisionSlop = profile.collisionSlop;
+				bool tuned = ImGui::SliderInt("Iterations", &profile.iterations, 1, 50);
+				if (ImGui::SliderFloat("Space Damping", &spaceDamping, 0.01, 1.0)) {
+					profile.damping = spaceDamping;
+					tuned = true;
+				}
+				if (ImGui::SliderFloat("Collision Slop", &collisionSlop, 0.0, 0.2)) {
+					profile.collisionSlop = collisionSlop;
+					tuned = true;
+				}
+				ImGui::PopItemWidth();
+				if (tuned) {
+					profile.name = "custom";
+					profileChanged = true;
+				}
+				if (profileChanged)
+					UIModelData::modelGrid().setProfile(profile);
+
+				int stepThreads = UIModelData::modelGrid().getStepThreads();
+				ImGui::PushItemWidth(-80);
+				if (ImGui::SliderInt("Step Threads", &stepThreads, 1, 16))
+					UIModelData::modelGrid().setStepThreads(stepThreads);
+				ImGui::PopItemWidth();
+				bool gridSolver = UIModelData::modelGrid().getGridSolver();
+				if (ImGui::Checkbox("Grid Solver", &gridSolver))
+					UIModelData::modelGrid().setGridSolver(gridSolver);
 				ImGui::End();
 			};
 		};
@@ -404,8 +452,21 @@ void main_draw_debug()
 				for (MMGrid& grid : UIModelData::gridSet) {
 					grid.setCells(rows, cols, UIModelData::cells);
 				}
+				UIModelData::restState = UIModelData::modelGrid().snapshot();
 				UIModelData::cellsEdited = false;
 			}
+			bool optimizationDone = false;
+			if (UIModelData::optimizer.poll(UIModelData::optimizerSnapshot, optimizationDone)) {
+				// best paths so far are shown while the optimizer runs, the layout is applied once it stops
+				UIModelData::allCalculatedPaths = UIModelData::optimizerSnapshot.calculatedPaths;
+				for (int index = 0; index < UIModelData::gridSet.size() && index < UIModelData::allCalculatedPaths.size(); index++) {
+					UIModelData::gridSet[index].setCalculatedPaths(UIModelData::allCalculatedPaths[index]);
+				}
+				if (optimizationDone && UIModelData::optimizerSnapshot.cells.size() == UIModelData::cells.size()) {
+					UIModelData::cells = UIModelData::optimizerSnapshot.cells;
+					UIModelData::cellsEdited = true;
+				}
+			}
 			if (UIModelData::sim_running) {
 				if (UIModelData::playing) {
 					UIModelData::modelGrid().update_follow_path(UIModelData::simTimestep, UIModelData::playbackPointsPerSecond);
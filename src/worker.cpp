@@ -0,0 +1,75 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "common/WorkerProtocol.hpp"
+
+// Simulation worker for dynamic_mm_optimize --workers: answers path set simulations sent over TCP
+// (see common/WorkerProtocol.hpp). Every connection gets its own thread, so one worker serves as many
+// concurrent simulations as the optimizers open connections to it.
+//
+// usage: dynamic_mm_worker [--port <port>] [--local]
+//   --port <port>           port to listen on (default 7700)
+//   --local                 only accept connections from this machine
+
+void print_usage()
+{
+	std::cout << "usage: dynamic_mm_worker [--port <port>] [--local]" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	int port = 7700;
+	bool local = false;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--port" && hasValue) {
+			port = std::atoi(argv[++i]);
+		}
+		else if (arg == "--local") {
+			local = true;
+		}
+		else {
+			std::cout << "unknown or incomplete option " << arg << std::endl;
+			print_usage();
+			return 1;
+		}
+	}
+
+#ifdef _WIN32
+	std::cout << "dynamic_mm_worker is not supported on this platform" << std::endl;
+	return 1;
+#else
+	int server = socket(AF_INET, SOCK_STREAM, 0);
+	int one = 1;
+	setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(local ? INADDR_LOOPBACK : INADDR_ANY);
+	if (server < 0 || bind(server, (sockaddr*)&address, sizeof(address)) != 0 || listen(server, 64) != 0)
+	{
+		std::cout << "could not listen on port " << port << std::endl;
+		return 1;
+	}
+	std::cout << "Listening on port " << port << std::endl;
+
+	while (true)
+	{
+		int fd = accept(server, nullptr, nullptr);
+		if (fd < 0)
+			continue;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		std::thread(WorkerProtocol::serve, fd).detach();
+	}
+#endif
+}